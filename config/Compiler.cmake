@@ -26,6 +26,12 @@ if (BSOID_PARALLEL)
     add_definitions(-DBSOID_PARALLEL)
 endif()
 
+# Field evaluation counters cost a thread-local increment per evaluation, so
+# they can be compiled out of builds that are only timed.
+if (BSOID_EVAL_COUNTERS)
+    add_definitions(-DBSOID_EVAL_COUNTERS)
+endif()
+
 # Now set the compiler flags, notice that Windows requires a different syntax
 # for flags than Linux does, so lets handle that one first.
 if (WIN32)
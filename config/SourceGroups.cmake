@@ -15,6 +15,7 @@ source_group("include\\bsoid\\models" FILES ${BSOID_INCLUDE_MODELS_GROUP})
 
 source_group("source" FILES ${BSOID_SOURCE_TOP_GROUP})
 source_group("source\\bsoid" FILES)
+source_group("source\\bsoid\\fields" FILES ${BSOID_SOURCE_FIELDS_GROUP})
 source_group("source\\bsoid\\tree" FILES ${BSOID_SOURCE_TREE_GROUP})
 source_group("source\\bsoid\\polygonizer" FILES 
     ${BSOID_SOURCE_POLYGONIZER_GROUP})
@@ -5,8 +5,11 @@
 
 #include "bsoid/Bsoid.hpp"
 
+#include <atlas/math/Math.hpp>
+
 #include <functional>
 #include <memory>
+#include <cstddef>
 
 namespace bsoid
 {
@@ -15,10 +18,62 @@ namespace bsoid
         using FilterFn = std::function<float(float)>;
 
         class ImplicitField;
+        class SkeletalField;
         class Sphere;
         class Torus;
+        class Program;
 
         using ImplicitFieldPtr = std::shared_ptr<ImplicitField>;
+
+        struct FieldValue
+        {
+            float value;
+            atlas::math::Normal g;
+        };
+
+        // Conservative bounds on the values a field takes over a region.
+        // The field may never actually reach either end.
+        struct FieldInterval
+        {
+            bool contains(float value) const
+            {
+                return lo <= value && value <= hi;
+            }
+
+            float lo;
+            float hi;
+        };
+
+        // Operators evaluate batches in chunks of at most this many points,
+        // so that their scratch space can live on the stack.
+        static constexpr std::size_t batchSize = 64;
+
+        // A structure-of-arrays view over a batch of points.
+        struct PointSpan
+        {
+            PointSpan subspan(std::size_t offset, std::size_t count) const
+            {
+                return { x + offset, y + offset, z + offset, count };
+            }
+
+            float const* x;
+            float const* y;
+            float const* z;
+            std::size_t size;
+        };
+
+        // A structure-of-arrays view over the gradients of a batch.
+        struct NormalSpan
+        {
+            NormalSpan subspan(std::size_t offset) const
+            {
+                return { x + offset, y + offset, z + offset };
+            }
+
+            float* x;
+            float* y;
+            float* z;
+        };
     }
 }
 
@@ -48,6 +48,41 @@ namespace bsoid
             return (A * x4) + (B * x2) - C;
 
         }
+
+        // Evaluates compactField and compactGradient together so that the
+        // powers of x are only computed once.
+        inline void compactFieldGradient(float dist, float& field, 
+            float& gradient)
+        {
+            if (dist < -radius)
+            {
+                field = 1.0f;
+                gradient = 0.0f;
+                return;
+            }
+            if (dist > radius)
+            {
+                field = 0.0f;
+                gradient = 0.0f;
+                return;
+            }
+
+            const float x = dist / radius;
+            const float x2 = x * x;
+            const float x3 = x2 * x;
+            const float x4 = x2 * x2;
+            const float x5 = x3 * x * x;    // Rounds like compactField.
+            static constexpr float FA = -3.0f / 16;
+            static constexpr float FB = 5.0f / 8;
+            static constexpr float FC = 15.0f / 16.0f;
+            static constexpr float FD = 0.5f;
+            static constexpr float GA = -15.0f / 16;
+            static constexpr float GB = 15.0f / 8;
+            static constexpr float GC = 15.0f / 16;
+
+            field = (FA * x5) + (FB * x3) - (FC * x) + FD;
+            gradient = (GA * x4) + (GB * x2) - GC;
+        }
     }
 }
 
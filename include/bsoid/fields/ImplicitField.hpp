@@ -5,12 +5,15 @@
 
 #include "Fields.hpp"
 #include "Filters.hpp"
+#include "Kernels.hpp"
+#include "Program.hpp"
 
 #include <atlas/math/Math.hpp>
 #include <atlas/utils/BBox.hpp>
 
 #include <vector>
-#include <atomic>
+#include <cstdint>
+#include <limits>
 
 namespace bsoid
 {
@@ -19,9 +22,7 @@ namespace bsoid
         class ImplicitField
         {
         public:
-            ImplicitField() :
-                mCounter(0)
-            { }
+            ImplicitField() = default;
 
             virtual ~ImplicitField() = default;
 
@@ -34,7 +35,6 @@ namespace bsoid
 
             virtual float eval(atlas::math::Point const& p) const
             {
-                ++mCounter;
                 return compactField(sdf(p));
             }
 
@@ -43,11 +43,76 @@ namespace bsoid
                 return compactGradient(sdf(p)) * sdg(p);
             }
 
+            // Computes both the value and the gradient with a single
+            // traversal of the field.
+            virtual FieldValue evalGrad(atlas::math::Point const& p) const
+            {
+                atlas::math::Normal g;
+                float value, gradient;
+                compactFieldGradient(sdfg(p, g), value, gradient);
+                return { value, gradient * g };
+            }
+
+            // The same as evalGrad, except that nothing is counted, just as
+            // in grad. Unions and intersections take their gradient from
+            // the child with the winning value, so they need the values
+            // even when only the gradient is asked for.
+            virtual FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const
+            {
+                return ImplicitField::evalGrad(p);
+            }
+
+            // Evaluates a whole batch of points at once. Leaves compute the
+            // distances with sdfBatch and run the falloff through the
+            // vectorized kernels.
+            virtual void evalBatch(PointSpan const& points, 
+                float* values) const
+            {
+                sdfBatch(points, values);
+                kernels::compactField(values, values, points.size);
+            }
+
+            virtual void evalGradBatch(PointSpan const& points, float* values,
+                NormalSpan const& gradients) const
+            {
+                for (std::size_t i = 0; i < points.size; ++i)
+                {
+                    auto v = evalGrad(
+                        { points.x[i], points.y[i], points.z[i] });
+                    values[i] = v.value;
+                    gradients.x[i] = v.g.x;
+                    gradients.y[i] = v.g.y;
+                    gradients.z[i] = v.g.z;
+                }
+            }
+
+            // Bounds the field over a box. The falloff is decreasing, so the
+            // far end of the distance bounds the field from below and the
+            // near end bounds it from above.
+            virtual FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const
+            {
+                float dMin, dMax;
+                sdfInterval(box, dMin, dMax);
+                return { compactField(dMax), compactField(dMin) };
+            }
+
+            // Emits the instructions that evaluate this field into program.
+            // Fields without instructions of their own are called through
+            // this interface by the program.
+            virtual void compile(Program& program) const
+            {
+                program.addField(this);
+            }
+
             virtual std::vector<atlas::math::Point> getSeeds() const = 0;
 
-            std::uint64_t getCount() const
+            // Only skeletal fields count their evaluations, everything else
+            // reports none.
+            virtual std::uint64_t getCount() const
             {
-                return mCounter.load();
+                return 0;
             }
 
         protected:
@@ -55,8 +120,32 @@ namespace bsoid
             virtual atlas::math::Normal sdg(atlas::math::Point const& p) const = 0;
             virtual atlas::utils::BBox box() const = 0;
 
-        private:
-            mutable std::atomic<std::uint64_t> mCounter;
+            // Returns sdf(p) and writes sdg(p) into g. Fields that can share
+            // work between the two should override this.
+            virtual float sdfg(atlas::math::Point const& p, 
+                atlas::math::Normal& g) const
+            {
+                g = sdg(p);
+                return sdf(p);
+            }
+
+            virtual void sdfBatch(PointSpan const& points, float* out) const
+            {
+                for (std::size_t i = 0; i < points.size; ++i)
+                {
+                    out[i] = sdf({ points.x[i], points.y[i], points.z[i] });
+                }
+            }
+
+            // Bounds sdf over a box. Without anything better to go on, all
+            // that is known is that the field vanishes outside its bounds.
+            virtual void sdfInterval(atlas::utils::BBox const& box,
+                float& dMin, float& dMax) const
+            {
+                const float inf = std::numeric_limits<float>::infinity();
+                dMin = getBBox().overlaps(box) ? -inf : inf;
+                dMax = inf;
+            }
         };
     }
 }
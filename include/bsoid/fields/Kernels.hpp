@@ -0,0 +1,55 @@
+#ifndef BSOID_INCLUDE_BSOID_FIELDS_KERNELS_HPP
+#define BSOID_INCLUDE_BSOID_FIELDS_KERNELS_HPP
+
+#pragma once
+
+#include "Fields.hpp"
+
+#include <atlas/math/Math.hpp>
+
+namespace bsoid
+{
+    namespace fields
+    {
+        // Vectorized versions of the hot loops in the field evaluation. The
+        // instruction set is picked once at run time (AVX-512, AVX2 or plain
+        // scalar code), and every variant produces exactly the same results
+        // as the scalar functions they replace.
+        namespace kernels
+        {
+            char const* getIsaName();
+
+            // out[i] = compactField(dist[i]). dist and out may alias.
+            void compactField(float const* dist, float* out, std::size_t n);
+
+            void sphereSdf(PointSpan const& points,
+                atlas::math::Point const& centre, float radius, float* out);
+
+            void torusSdf(PointSpan const& points,
+                atlas::math::Point const& centre, float c, float a,
+                float* out);
+
+            // Applies the affine transform m to every point.
+            void transformPoints(PointSpan const& points,
+                atlas::math::Matrix4 const& m, float* x, float* y, float* z);
+
+            // Takes a gradient back out of the space of a transformed field.
+            // Gradients are directions, so only the linear part of the
+            // inverse transpose acts on them.
+            inline atlas::math::Normal transformGradient(
+                atlas::math::Matrix4 const& inverseT,
+                atlas::math::Normal const& g)
+            {
+                return atlas::math::Normal(
+                    inverseT[0][0] * g.x + inverseT[1][0] * g.y +
+                        inverseT[2][0] * g.z,
+                    inverseT[0][1] * g.x + inverseT[1][1] * g.y +
+                        inverseT[2][1] * g.z,
+                    inverseT[0][2] * g.x + inverseT[1][2] * g.y +
+                        inverseT[2][2] * g.z);
+            }
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef BSOID_INCLUDE_BSOID_FIELDS_PROGRAM_HPP
+#define BSOID_INCLUDE_BSOID_FIELDS_PROGRAM_HPP
+
+#pragma once
+
+#include "Fields.hpp"
+
+#include <atlas/math/Math.hpp>
+#include <atlas/utils/BBox.hpp>
+
+#include <vector>
+#include <cstdint>
+
+namespace bsoid
+{
+    namespace fields
+    {
+        // A field tree lowered into a flat list of instructions for a small
+        // stack machine. Leaves push their value (and gradient) onto the
+        // stack, the operators fold the top of the stack into the value
+        // below it, and the instructions between PushTransform and
+        // PopTransform see the point moved into the space of the
+        // transformed field. The parameters of the primitives are stored in
+        // one array per parameter, so evaluating a program walks a handful
+        // of contiguous arrays instead of chasing pointers through the tree.
+        //
+        // Evaluating a program gives exactly the same results as evaluating
+        // the tree it was compiled from, and counts the evaluations of its
+        // leaves the same way. Fields that have no instruction of their own
+        // are called through their virtual interface. Either way, a program
+        // refers to the fields it was compiled from, so it must not outlive
+        // them. A program with no instructions is the zero field.
+        //
+        // The children of a Blend, Union or Intersection with enough of them
+        // sit between Gather and one Next per child. Gather looks up the
+        // children whose bounds contain the point in a uniform grid and
+        // jumps to the first of them, each Next jumps to the following one,
+        // and the children that were skipped are folded in as the zero they
+        // evaluate to. Union and Intersection also stop as soon as none of
+        // the remaining children can change their value. Only the leaves
+        // that actually run are counted.
+        class Program
+        {
+        public:
+            enum class OpCode : std::uint8_t
+            {
+                Sphere,
+                Torus,
+                Field,
+                PushZero,
+                PushLowest,
+                PushHighest,
+                Add,
+                Max,
+                Min,
+                PushTransform,
+                PopTransform,
+                Gather,
+                Next
+            };
+
+            Program();
+            ~Program() = default;
+
+            void compile(ImplicitField const& root);
+            void clear();
+
+            // These are called by ImplicitField::compile to emit the
+            // instructions for each field.
+            void addSphere(SkeletalField const* field,
+                atlas::math::Point const& centre, float radius);
+            void addTorus(SkeletalField const* field,
+                atlas::math::Point const& centre, float c, float a);
+            void addField(ImplicitField const* field);
+            void addOp(OpCode op);
+            void pushTransform(atlas::math::Matrix4 const& inverse,
+                atlas::math::Matrix4 const& inverseT);
+            void popTransform();
+
+            // Wrap the children of an operator that folds them with
+            // combine, which is one of Add, Max or Min. The value the
+            // children are folded into must already be on the stack.
+            // Operators with fewer than gatherMinChildren children simply
+            // evaluate all of them.
+            static constexpr std::size_t gatherMinChildren = 4;
+
+            void beginChildren(OpCode combine, std::size_t count);
+            void beginChild(ImplicitField const& child);
+            void endChild();
+            void endChildren();
+
+            float eval(atlas::math::Point const& p) const;
+            atlas::math::Normal grad(atlas::math::Point const& p) const;
+            FieldValue evalGrad(atlas::math::Point const& p) const;
+            void evalBatch(PointSpan const& points, float* values) const;
+            void evalGradBatch(PointSpan const& points, float* values,
+                NormalSpan const& gradients) const;
+
+            bool empty() const;
+            std::size_t size() const;
+
+        private:
+            struct Instruction
+            {
+                OpCode op;
+                std::uint32_t arg;
+            };
+
+            struct Spheres
+            {
+                std::vector<float> x, y, z, radius;
+                std::vector<SkeletalField const*> field;
+            };
+
+            struct Tori
+            {
+                std::vector<float> x, y, z, c, a;
+                std::vector<SkeletalField const*> field;
+            };
+
+            // The children of one operator. Each cell of the grid lists the
+            // children whose bounds overlap it in the order they were
+            // compiled, and the list past the last cell holds the children
+            // without usable bounds, which are in every other list as well.
+            struct Gather
+            {
+                std::uint32_t const* find(atlas::math::Point const& p,
+                    std::size_t& count) const;
+                std::size_t collect(atlas::utils::BBox const& box,
+                    std::uint32_t* children) const;
+                bool saturated(float value) const;
+
+                OpCode combine;
+                std::uint32_t end;
+
+                // Bounds on the values of the children, used to stop a
+                // Union or Intersection early.
+                float lo, hi;
+
+                std::vector<std::uint32_t> starts;
+                std::vector<atlas::utils::BBox> boxes;
+                std::vector<bool> bounded;
+
+                atlas::math::Point origin, limit, cellSize;
+                int dims[3];
+                std::vector<std::uint32_t> cellStarts, cellChildren;
+            };
+
+            struct OpenGather
+            {
+                OpCode combine;
+                bool gather;
+                std::uint32_t index;
+            };
+
+            struct GatherState
+            {
+                Gather const* gather;
+                std::uint32_t const* children;
+                std::size_t count;
+                std::size_t next;
+            };
+
+            FieldValue trace(atlas::math::Point const& p, bool grad) const;
+            void emit(OpCode op, std::size_t arg, int push);
+            void buildGrid(Gather& gather);
+
+            std::vector<Instruction> mCode;
+            Spheres mSpheres;
+            Tori mTori;
+            std::vector<ImplicitField const*> mFields;
+            std::vector<atlas::math::Matrix4> mInverse, mInverseT;
+            std::vector<Gather> mGathers;
+
+            std::vector<std::uint32_t> mOpenTransforms;
+            std::vector<OpenGather> mOpenGathers;
+            std::size_t mDepth, mMaxDepth;
+            std::size_t mMaxTransformDepth;
+            std::size_t mMaxGatherDepth, mMaxChildren;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef BSOID_INCLUDE_BSOID_FIELDS_SKELETAL_FIELD_HPP
+#define BSOID_INCLUDE_BSOID_FIELDS_SKELETAL_FIELD_HPP
+
+#pragma once
+
+#include "ImplicitField.hpp"
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <cstdint>
+
+namespace bsoid
+{
+    namespace fields
+    {
+        // The leaves of the field tree. These are the only fields whose
+        // evaluations are counted, whether they are evaluated directly or by
+        // a program.
+        class SkeletalField : public ImplicitField
+        {
+        public:
+            SkeletalField() = default;
+            virtual ~SkeletalField() = default;
+
+            float eval(atlas::math::Point const& p) const override
+            {
+                countEvaluations(1);
+                return ImplicitField::eval(p);
+            }
+
+            FieldValue evalGrad(atlas::math::Point const& p) const override
+            {
+                countEvaluations(1);
+                return ImplicitField::evalGrad(p);
+            }
+
+            void evalBatch(PointSpan const& points,
+                float* values) const override
+            {
+                countEvaluations(points.size);
+                ImplicitField::evalBatch(points, values);
+            }
+
+            // Returns the number of evaluations made by all threads so far,
+            // or 0 if the counters are compiled out.
+            std::uint64_t getCount() const override
+            {
+                std::uint64_t total = 0;
+#if defined(BSOID_EVAL_COUNTERS)
+                for (auto count : mCounters)
+                {
+                    total += count;
+                }
+#endif
+                return total;
+            }
+
+        protected:
+            // For fields that override the evaluation functions.
+            void countEvaluations(std::uint64_t count) const
+            {
+#if defined(BSOID_EVAL_COUNTERS)
+                mCounters.local() += count;
+#else
+                (void)count;
+#endif
+            }
+
+        private:
+            friend class Program;
+
+#if defined(BSOID_EVAL_COUNTERS)
+            // Each thread counts into its own slot, and the slots are padded
+            // to separate cache lines, so concurrent evaluations of the same
+            // field never contend on the counter.
+            mutable tbb::enumerable_thread_specific<std::uint64_t> mCounters;
+#endif
+        };
+    }
+}
+
+#endif
@@ -3,13 +3,16 @@
 
 #pragma once
 
-#include "ImplicitField.hpp"
+#include "SkeletalField.hpp"
+
+#include <algorithm>
+#include <cmath>
 
 namespace bsoid
 {
     namespace fields
     {
-        class Sphere : public ImplicitField
+        class Sphere : public SkeletalField
         {
         public:
             Sphere() :
@@ -24,6 +27,11 @@ namespace bsoid
 
             ~Sphere() = default;
 
+            void compile(Program& program) const override
+            {
+                program.addSphere(this, mCentre, mRadius);
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 auto seed = mCentre;
@@ -42,6 +50,39 @@ namespace bsoid
                 return 2.0f * (p - mCentre);
             }
 
+            float sdfg(atlas::math::Point const& p, 
+                atlas::math::Normal& g) const override
+            {
+                auto d = p - mCentre;
+                g = 2.0f * d;
+                return glm::length(d) - mRadius;
+            }
+
+            void sdfBatch(PointSpan const& points, float* out) const override
+            {
+                kernels::sphereSdf(points, mCentre, mRadius, out);
+            }
+
+            // The nearest point of the box is the centre clamped to it, and
+            // the farthest one is the corner furthest away on every axis.
+            void sdfInterval(atlas::utils::BBox const& box, float& dMin,
+                float& dMax) const override
+            {
+                using atlas::math::Point;
+
+                Point near, far;
+                for (int i = 0; i < 3; ++i)
+                {
+                    float lo = box.pMin[i] - mCentre[i];
+                    float hi = box.pMax[i] - mCentre[i];
+                    near[i] = std::max(lo, std::min(hi, 0.0f));
+                    far[i] = std::max(std::abs(lo), std::abs(hi));
+                }
+
+                dMin = glm::length(near) - mRadius;
+                dMax = glm::length(far) - mRadius;
+            }
+
             atlas::utils::BBox box() const override
             {
                 using atlas::utils::BBox;
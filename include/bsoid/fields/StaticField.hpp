@@ -0,0 +1,635 @@
+#ifndef BSOID_INCLUDE_BSOID_FIELDS_STATIC_FIELD_HPP
+#define BSOID_INCLUDE_BSOID_FIELDS_STATIC_FIELD_HPP
+
+#pragma once
+
+#include "SkeletalField.hpp"
+#include "Filters.hpp"
+#include "Kernels.hpp"
+
+#include <atlas/core/Constants.hpp>
+#include <atlas/math/Math.hpp>
+#include <atlas/utils/BBox.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace bsoid
+{
+    namespace fields
+    {
+        // Models that are fixed at compile time can be written as an
+        // expression instead of a tree of shared fields, as in
+        //
+        //   auto field = makeStaticField(blend(
+        //       transform(m, sphere()), torus()));
+        //
+        // Every node of an expression is a plain value whose type records
+        // the shape of the tree below it, so evaluating the whole thing
+        // inlines into a single function with no virtual calls and no
+        // counters along the way. StaticField wraps an expression as a
+        // single ImplicitField for the polygonizers.
+        //
+        // Each expression provides the following, which follow the runtime
+        // fields operation for operation, so a static field gives the same
+        // values as the tree it was written from:
+        //
+        //   float eval(Point const& p) const;
+        //   FieldValue evalGrad(Point const& p) const;
+        //   FieldInterval interval(atlas::utils::BBox const& box) const;
+        //   atlas::utils::BBox bbox() const;
+        //   void seeds(std::vector<Point>& seeds) const;
+        //
+        // Operators skip the children whose bounds do not contain the point,
+        // just like the compiled programs do.
+        namespace expr
+        {
+            namespace detail
+            {
+                template <typename Tuple, typename Fn, std::size_t... I>
+                void forEach(Tuple const& tuple, Fn&& fn,
+                    std::index_sequence<I...>)
+                {
+                    using Swallow = int[];
+                    (void)Swallow{ 0, (fn(std::get<I>(tuple)), 0)... };
+                }
+
+                // Calls fn on every element of the tuple, in order.
+                template <typename... Es, typename Fn>
+                void forEach(std::tuple<Es...> const& tuple, Fn&& fn)
+                {
+                    forEach(tuple, fn, std::index_sequence_for<Es...>());
+                }
+            }
+
+            class SphereExpr
+            {
+            public:
+                SphereExpr(float radius, atlas::math::Point const& centre) :
+                    mRadius(radius),
+                    mCentre(centre)
+                { }
+
+                float eval(atlas::math::Point const& p) const
+                {
+                    return compactField(glm::length(p - mCentre) - mRadius);
+                }
+
+                FieldValue evalGrad(atlas::math::Point const& p) const
+                {
+                    auto d = p - mCentre;
+                    atlas::math::Normal g = 2.0f * d;
+
+                    float value, gradient;
+                    compactFieldGradient(glm::length(d) - mRadius, value,
+                        gradient);
+                    return { value, gradient * g };
+                }
+
+                FieldInterval interval(atlas::utils::BBox const& box) const
+                {
+                    using atlas::math::Point;
+
+                    Point near, far;
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        float lo = box.pMin[i] - mCentre[i];
+                        float hi = box.pMax[i] - mCentre[i];
+                        near[i] = std::max(lo, std::min(hi, 0.0f));
+                        far[i] = std::max(std::abs(lo), std::abs(hi));
+                    }
+
+                    return { compactField(glm::length(far) - mRadius),
+                        compactField(glm::length(near) - mRadius) };
+                }
+
+                atlas::utils::BBox bbox() const
+                {
+                    atlas::utils::BBox box(mCentre - mRadius,
+                        mCentre + mRadius);
+                    box.expand(1.0f);
+                    return box;
+                }
+
+                void seeds(std::vector<atlas::math::Point>& seeds) const
+                {
+                    auto seed = mCentre;
+                    seed.x += mRadius;
+                    seeds.push_back(seed);
+                }
+
+            private:
+                float mRadius;
+                atlas::math::Point mCentre;
+            };
+
+            class TorusExpr
+            {
+            public:
+                TorusExpr(float c, float a, atlas::math::Point const& centre) :
+                    mC(c),
+                    mA(a),
+                    mCentre(centre)
+                { }
+
+                float eval(atlas::math::Point const& p) const
+                {
+                    using atlas::math::Point2;
+
+                    float root = glm::length(
+                        Point2(p.x - mCentre.x, p.y - mCentre.y));
+                    float z2 = (p.z - mCentre.z) * (p.z - mCentre.z);
+                    float left = (mC - root) * (mC - root);
+                    return compactField(left + z2 - (mA * mA));
+                }
+
+                FieldValue evalGrad(atlas::math::Point const& p) const
+                {
+                    using atlas::math::Point2;
+
+                    auto d = p - mCentre;
+                    float root = glm::length(Point2(d.x, d.y));
+                    atlas::math::Normal g;
+                    g.x = -2.0f * (mC - root) * d.x / root;
+                    g.y = -2.0f * (mC - root) * d.y / root;
+                    g.z = 2.0f * d.z;
+
+                    float value, gradient;
+                    compactFieldGradient((mC - root) * (mC - root) +
+                        d.z * d.z - (mA * mA), value, gradient);
+                    return { value, gradient * g };
+                }
+
+                FieldInterval interval(atlas::utils::BBox const& box) const
+                {
+                    using atlas::math::Point;
+
+                    auto square = [](float lo, float hi, float& sMin,
+                        float& sMax)
+                    {
+                        sMax = std::max(lo * lo, hi * hi);
+                        sMin = (lo <= 0.0f && hi >= 0.0f) ?
+                            0.0f : std::min(lo * lo, hi * hi);
+                    };
+
+                    Point lo = box.pMin - mCentre;
+                    Point hi = box.pMax - mCentre;
+
+                    float nx = std::max(lo.x, std::min(hi.x, 0.0f));
+                    float ny = std::max(lo.y, std::min(hi.y, 0.0f));
+                    float fx = std::max(std::abs(lo.x), std::abs(hi.x));
+                    float fy = std::max(std::abs(lo.y), std::abs(hi.y));
+                    float rootMin = std::sqrt(nx * nx + ny * ny);
+                    float rootMax = std::sqrt(fx * fx + fy * fy);
+
+                    float rMin, rMax, zMin, zMax;
+                    square(mC - rootMax, mC - rootMin, rMin, rMax);
+                    square(lo.z, hi.z, zMin, zMax);
+
+                    return { compactField(rMax + zMax - (mA * mA)),
+                        compactField(rMin + zMin - (mA * mA)) };
+                }
+
+                atlas::utils::BBox bbox() const
+                {
+                    using atlas::math::Point;
+
+                    Point p = {  mC + mA,  mC + mA, -mA };
+                    Point q = { -mC - mA, -mC - mA,  mA };
+                    atlas::utils::BBox box(mCentre + p, mCentre + q);
+                    box.expand(1.0f);
+                    return box;
+                }
+
+                void seeds(std::vector<atlas::math::Point>& seeds) const
+                {
+                    auto seed = mCentre;
+                    seed.x += (mC - mA);
+                    seeds.push_back(seed);
+                }
+
+            private:
+                float mC, mA;
+                atlas::math::Point mCentre;
+            };
+
+            template <typename E>
+            class TransformExpr
+            {
+            public:
+                TransformExpr(atlas::math::Matrix4 const& t, E const& child) :
+                    mTransform(t),
+                    mInverse(glm::inverse(t)),
+                    mInverseT(glm::transpose(mInverse)),
+                    mChild(child)
+                { }
+
+                float eval(atlas::math::Point const& p) const
+                {
+                    using atlas::math::Point;
+                    using atlas::math::Point4;
+
+                    return mChild.eval(Point(mInverse * Point4(p, 1.0f)));
+                }
+
+                FieldValue evalGrad(atlas::math::Point const& p) const
+                {
+                    using atlas::math::Point;
+                    using atlas::math::Point4;
+
+                    auto v = mChild.evalGrad(Point(mInverse * Point4(p, 1.0f)));
+                    v.g = kernels::transformGradient(mInverseT, v.g);
+                    return v;
+                }
+
+                atlas::utils::BBox bbox() const
+                {
+                    using atlas::math::Point;
+                    using atlas::math::Point4;
+
+                    auto b = mChild.bbox();
+                    atlas::utils::BBox box;
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        Point4 corner(
+                            (i & 4) ? b.pMax.x : b.pMin.x,
+                            (i & 2) ? b.pMax.y : b.pMin.y,
+                            (i & 1) ? b.pMax.z : b.pMin.z, 1.0f);
+                        box = atlas::utils::join(box,
+                            Point(mTransform * corner));
+                    }
+
+                    return box;
+                }
+
+                FieldInterval interval(atlas::utils::BBox const& box) const
+                {
+                    using atlas::math::Point;
+                    using atlas::math::Point4;
+
+                    atlas::utils::BBox local;
+                    for (int i = 0; i < 8; ++i)
+                    {
+                        Point4 corner(
+                            (i & 4) ? box.pMax.x : box.pMin.x,
+                            (i & 2) ? box.pMax.y : box.pMin.y,
+                            (i & 1) ? box.pMax.z : box.pMin.z, 1.0f);
+                        local = atlas::utils::join(local,
+                            Point(mInverse * corner));
+                    }
+
+                    return mChild.interval(local);
+                }
+
+                void seeds(std::vector<atlas::math::Point>& seeds) const
+                {
+                    using atlas::math::Point;
+                    using atlas::math::Point4;
+
+                    std::vector<Point> local;
+                    mChild.seeds(local);
+                    for (auto& seed : local)
+                    {
+                        seeds.push_back(Point(mTransform * Point4(seed, 1.0f)));
+                    }
+                }
+
+            private:
+                atlas::math::Matrix4 mTransform, mInverse, mInverseT;
+                E mChild;
+            };
+
+            // The operators only differ in how they fold their children.
+            struct BlendOp
+            {
+                static float identity()
+                {
+                    return 0.0f;
+                }
+
+                template <typename T>
+                static T apply(T const& a, T const& b)
+                {
+                    return a + b;
+                }
+
+                static FieldValue applyGrad(FieldValue const& a,
+                    FieldValue const& b)
+                {
+                    return { a.value + b.value, a.g + b.g };
+                }
+
+                static atlas::utils::BBox bound(atlas::utils::BBox const& a,
+                    atlas::utils::BBox const& b)
+                {
+                    return atlas::utils::join(a, b);
+                }
+            };
+
+            struct UnionOp
+            {
+                static float identity()
+                {
+                    return -std::numeric_limits<float>::infinity();
+                }
+
+                template <typename T>
+                static T apply(T const& a, T const& b)
+                {
+                    return glm::max(a, b);
+                }
+
+                // The gradient is that of the child with the larger value.
+                static FieldValue applyGrad(FieldValue const& a,
+                    FieldValue const& b)
+                {
+                    return (b.value > a.value) ? b : a;
+                }
+
+                static atlas::utils::BBox bound(atlas::utils::BBox const& a,
+                    atlas::utils::BBox const& b)
+                {
+                    return atlas::utils::join(a, b);
+                }
+            };
+
+            struct IntersectionOp
+            {
+                static float identity()
+                {
+                    return atlas::core::infinity();
+                }
+
+                template <typename T>
+                static T apply(T const& a, T const& b)
+                {
+                    return glm::min(a, b);
+                }
+
+                // The gradient is that of the child with the smaller value.
+                static FieldValue applyGrad(FieldValue const& a,
+                    FieldValue const& b)
+                {
+                    return (b.value < a.value) ? b : a;
+                }
+
+                static atlas::utils::BBox bound(atlas::utils::BBox const& a,
+                    atlas::utils::BBox const& b)
+                {
+                    atlas::utils::BBox box;
+                    box.pMin = glm::max(a.pMin, b.pMin);
+                    box.pMax = glm::min(a.pMax, b.pMax);
+                    return box;
+                }
+            };
+
+            template <typename Op, typename... Es>
+            class FoldExpr
+            {
+            public:
+                static_assert(sizeof...(Es) > 0,
+                    "An operator needs at least one child.");
+
+                FoldExpr(Es const&... children) :
+                    mChildren(children...),
+                    mBoxes{ { children.bbox()... } }
+                { }
+
+                float eval(atlas::math::Point const& p) const
+                {
+                    float value = Op::identity();
+                    std::size_t i = 0;
+                    detail::forEach(mChildren,
+                        [this, &p, &value, &i](auto const& e)
+                    {
+                        value = Op::apply(value,
+                            (contains(mBoxes[i++], p)) ? e.eval(p) : 0.0f);
+                    });
+                    return value;
+                }
+
+                FieldValue evalGrad(atlas::math::Point const& p) const
+                {
+                    FieldValue result = { Op::identity(),
+                        atlas::math::Normal(Op::identity()) };
+                    std::size_t i = 0;
+                    detail::forEach(mChildren,
+                        [this, &p, &result, &i](auto const& e)
+                    {
+                        FieldValue v = { 0.0f, atlas::math::Normal(0.0f) };
+                        if (contains(mBoxes[i++], p))
+                        {
+                            v = e.evalGrad(p);
+                        }
+
+                        result = Op::applyGrad(result, v);
+                    });
+                    return result;
+                }
+
+                FieldInterval interval(atlas::utils::BBox const& box) const
+                {
+                    FieldInterval result = { Op::identity(), Op::identity() };
+                    detail::forEach(mChildren, [&box, &result](auto const& e)
+                    {
+                        auto r = e.interval(box);
+                        result.lo = Op::apply(result.lo, r.lo);
+                        result.hi = Op::apply(result.hi, r.hi);
+                    });
+                    return result;
+                }
+
+                atlas::utils::BBox bbox() const
+                {
+                    auto box = mBoxes[0];
+                    for (auto& b : mBoxes)
+                    {
+                        box = Op::bound(box, b);
+                    }
+
+                    return box;
+                }
+
+                void seeds(std::vector<atlas::math::Point>& seeds) const
+                {
+                    detail::forEach(mChildren, [&seeds](auto const& e)
+                    {
+                        e.seeds(seeds);
+                    });
+                }
+
+            private:
+                static bool contains(atlas::utils::BBox const& box,
+                    atlas::math::Point const& p)
+                {
+                    return box.pMin.x <= p.x && p.x <= box.pMax.x &&
+                        box.pMin.y <= p.y && p.y <= box.pMax.y &&
+                        box.pMin.z <= p.z && p.z <= box.pMax.z;
+                }
+
+                std::tuple<Es...> mChildren;
+                std::array<atlas::utils::BBox, sizeof...(Es)> mBoxes;
+            };
+
+            template <typename... Es>
+            using BlendExpr = FoldExpr<BlendOp, Es...>;
+            template <typename... Es>
+            using UnionExpr = FoldExpr<UnionOp, Es...>;
+            template <typename... Es>
+            using IntersectionExpr = FoldExpr<IntersectionOp, Es...>;
+
+            inline SphereExpr sphere(float radius = 1.0f,
+                atlas::math::Point const& centre = atlas::math::Point(0.0f))
+            {
+                return SphereExpr(radius, centre);
+            }
+
+            inline TorusExpr torus(float c = 2.0f, float a = 1.0f,
+                atlas::math::Point const& centre = atlas::math::Point(0.0f))
+            {
+                return TorusExpr(c, a, centre);
+            }
+
+            template <typename E>
+            TransformExpr<E> transform(atlas::math::Matrix4 const& t,
+                E const& child)
+            {
+                return TransformExpr<E>(t, child);
+            }
+
+            template <typename... Es>
+            BlendExpr<Es...> blend(Es const&... children)
+            {
+                return BlendExpr<Es...>(children...);
+            }
+
+            // Union is a keyword.
+            template <typename... Es>
+            UnionExpr<Es...> unite(Es const&... children)
+            {
+                return UnionExpr<Es...>(children...);
+            }
+
+            template <typename... Es>
+            IntersectionExpr<Es...> intersect(Es const&... children)
+            {
+                return IntersectionExpr<Es...>(children...);
+            }
+        }
+
+        template <typename E>
+        class StaticField : public SkeletalField
+        {
+        public:
+            StaticField(E const& expr) :
+                mExpr(expr),
+                mBox(expr.bbox())
+            { }
+
+            ~StaticField() = default;
+
+            atlas::utils::BBox getBBox() const override
+            {
+                return mBox;
+            }
+
+            // The whole expression counts as one evaluation.
+            float eval(atlas::math::Point const& p) const override
+            {
+                countEvaluations(1);
+                return mExpr.eval(p);
+            }
+
+            atlas::math::Normal grad(atlas::math::Point const& p) const override
+            {
+                return mExpr.evalGrad(p).g;
+            }
+
+            FieldValue evalGrad(atlas::math::Point const& p) const override
+            {
+                countEvaluations(1);
+                return mExpr.evalGrad(p);
+            }
+
+            FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const override
+            {
+                return mExpr.evalGrad(p);
+            }
+
+            void evalBatch(PointSpan const& points,
+                float* values) const override
+            {
+                countEvaluations(points.size);
+                for (std::size_t i = 0; i < points.size; ++i)
+                {
+                    values[i] = mExpr.eval(
+                        { points.x[i], points.y[i], points.z[i] });
+                }
+            }
+
+            void evalGradBatch(PointSpan const& points, float* values,
+                NormalSpan const& gradients) const override
+            {
+                countEvaluations(points.size);
+                for (std::size_t i = 0; i < points.size; ++i)
+                {
+                    auto v = mExpr.evalGrad(
+                        { points.x[i], points.y[i], points.z[i] });
+                    values[i] = v.value;
+                    gradients.x[i] = v.g.x;
+                    gradients.y[i] = v.g.y;
+                    gradients.z[i] = v.g.z;
+                }
+            }
+
+            FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override
+            {
+                return mExpr.interval(box);
+            }
+
+            std::vector<atlas::math::Point> getSeeds() const override
+            {
+                std::vector<atlas::math::Point> seeds;
+                mExpr.seeds(seeds);
+                return seeds;
+            }
+
+        private:
+            // The values come straight from the expression, so the distance
+            // functions that the defaults above are built on are never
+            // reached. They return the field itself.
+            float sdf(atlas::math::Point const& p) const override
+            {
+                return mExpr.eval(p);
+            }
+
+            atlas::math::Normal sdg(atlas::math::Point const& p) const override
+            {
+                return mExpr.evalGrad(p).g;
+            }
+
+            atlas::utils::BBox box() const override
+            {
+                return mBox;
+            }
+
+            E mExpr;
+            atlas::utils::BBox mBox;
+        };
+
+        template <typename E>
+        std::shared_ptr<StaticField<E>> makeStaticField(E const& expr)
+        {
+            return std::make_shared<StaticField<E>>(expr);
+        }
+    }
+}
+
+#endif
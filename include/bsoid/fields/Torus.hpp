@@ -3,15 +3,18 @@
 
 #pragma once
 
-#include "ImplicitField.hpp"
+#include "SkeletalField.hpp"
 
 #include <atlas/core/Float.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 namespace bsoid
 {
     namespace fields
     {
-        class Torus : public ImplicitField
+        class Torus : public SkeletalField
         {
         public:
             Torus() :
@@ -28,6 +31,11 @@ namespace bsoid
 
             ~Torus() = default;
 
+            void compile(Program& program) const override
+            {
+                program.addTorus(this, mCentre, mC, mA);
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 auto pt = mCentre;
@@ -60,13 +68,64 @@ namespace bsoid
                 return Normal(dx, dy, dz);
             }
 
+            float sdfg(atlas::math::Point const& p, 
+                atlas::math::Normal& g) const override
+            {
+                auto d = p - mCentre;
+                float root = glm::length(p.xy() - mCentre.xy());
+                g.x = -2.0f * (mC - root) * d.x / root;
+                g.y = -2.0f * (mC - root) * d.y / root;
+                g.z = 2.0f * d.z;
+
+                return (mC - root) * (mC - root) + d.z * d.z - (mA * mA);
+            }
+
+            void sdfBatch(PointSpan const& points, float* out) const override
+            {
+                kernels::torusSdf(points, mCentre, mC, mA, out);
+            }
+
+            // Bounds the distance from the axis and the height over the box
+            // separately, then squares each range. A square only reaches
+            // zero when the range straddles it.
+            void sdfInterval(atlas::utils::BBox const& box, float& dMin,
+                float& dMax) const override
+            {
+                using atlas::math::Point;
+
+                auto square = [](float lo, float hi, float& sMin,
+                    float& sMax)
+                {
+                    sMax = std::max(lo * lo, hi * hi);
+                    sMin = (lo <= 0.0f && hi >= 0.0f) ?
+                        0.0f : std::min(lo * lo, hi * hi);
+                };
+
+                Point lo = box.pMin - mCentre;
+                Point hi = box.pMax - mCentre;
+
+                float nx = std::max(lo.x, std::min(hi.x, 0.0f));
+                float ny = std::max(lo.y, std::min(hi.y, 0.0f));
+                float fx = std::max(std::abs(lo.x), std::abs(hi.x));
+                float fy = std::max(std::abs(lo.y), std::abs(hi.y));
+                float rootMin = std::sqrt(nx * nx + ny * ny);
+                float rootMax = std::sqrt(fx * fx + fy * fy);
+
+                float rMin, rMax, zMin, zMax;
+                square(mC - rootMax, mC - rootMin, rMin, rMax);
+                square(lo.z, hi.z, zMin, zMax);
+
+                dMin = rMin + zMin - (mA * mA);
+                dMax = rMax + zMax - (mA * mA);
+            }
+
             atlas::utils::BBox box() const override
             {
                 using atlas::math::Point;
 
                 Point p = {  mC + mA,  mC + mA, -mA };
                 Point q = { -mC - mA, -mC - mA,  mA };
-                return atlas::utils::BBox(p, q);
+                return atlas::utils::BBox(mCentre + p, mCentre + q);
             }
 
             float mC, mA;
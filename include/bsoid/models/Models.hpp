@@ -45,6 +45,11 @@ namespace bsoid
 
         MAKE_FUNCTION(Chain);
 
+        // The same models written as static fields, for comparing the two.
+        MAKE_FUNCTION(StaticTorus);
+        MAKE_FUNCTION(StaticButterfly);
+        MAKE_FUNCTION(StaticChain);
+
     }
 }
 
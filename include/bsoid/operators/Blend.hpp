@@ -18,6 +18,21 @@ namespace bsoid
 
             ~Blend() = default;
 
+            void compile(fields::Program& program) const override
+            {
+                using OpCode = fields::Program::OpCode;
+
+                program.addOp(OpCode::PushZero);
+                program.beginChildren(OpCode::Add, mFields.size());
+                for (auto& f : mFields)
+                {
+                    program.beginChild(*f);
+                    f->compile(program);
+                    program.endChild();
+                }
+                program.endChildren();
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 std::vector<atlas::math::Point> result;
@@ -30,6 +45,80 @@ namespace bsoid
                 return result;
             }
 
+            fields::FieldValue evalGrad(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGrad);
+            }
+
+            fields::FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGradUncounted);
+            }
+
+            void evalBatch(fields::PointSpan const& points,
+                float* values) const override
+            {
+                std::fill(values, values + points.size, 0.0f);
+                forEachChunk(points, [this, values](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalBatch(chunk, field);
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            values[offset + i] += field[i];
+                        }
+                    }
+                });
+            }
+
+            void evalGradBatch(fields::PointSpan const& points, float* values,
+                fields::NormalSpan const& gradients) const override
+            {
+                std::fill(values, values + points.size, 0.0f);
+                std::fill(gradients.x, gradients.x + points.size, 0.0f);
+                std::fill(gradients.y, gradients.y + points.size, 0.0f);
+                std::fill(gradients.z, gradients.z + points.size, 0.0f);
+                forEachChunk(points, [this, values, &gradients](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    float gx[fields::batchSize];
+                    float gy[fields::batchSize];
+                    float gz[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalGradBatch(chunk, field, { gx, gy, gz });
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            auto j = offset + i;
+                            values[j] += field[i];
+                            gradients.x[j] += gx[i];
+                            gradients.y[j] += gy[i];
+                            gradients.z[j] += gz[i];
+                        }
+                    }
+                });
+            }
+
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override
+            {
+                fields::FieldInterval result = { 0.0f, 0.0f };
+                for (auto& f : mFields)
+                {
+                    auto v = f->evalInterval(box);
+                    result.lo += v.lo;
+                    result.hi += v.hi;
+                }
+
+                return result;
+            }
+
         private:
             float sdf(atlas::math::Point const& p) const override
             {
@@ -53,6 +142,21 @@ namespace bsoid
                 return gradient;
             }
 
+            fields::FieldValue foldGrad(atlas::math::Point const& p,
+                fields::FieldValue (fields::ImplicitField::*fn)(
+                    atlas::math::Point const&) const) const
+            {
+                fields::FieldValue result = { 0.0f, atlas::math::Normal(0.0f) };
+                for (auto& f : mFields)
+                {
+                    auto v = ((*f).*fn)(p);
+                    result.value += v.value;
+                    result.g += v.g;
+                }
+
+                return result;
+            }
+
             atlas::utils::BBox box() const override
             {
                 atlas::utils::BBox box;
@@ -64,9 +168,10 @@ namespace bsoid
                 return box;
             }
 
-            Blend* cloneEmpty() const override
+            ImplicitOperatorPtr cloneEmpty(
+                tree::Arena* arena) const override
             {
-                return new Blend;
+                return makeOperator<Blend>(arena);
             }
 
         };
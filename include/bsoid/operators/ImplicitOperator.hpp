@@ -5,8 +5,10 @@
 
 #include "Operators.hpp"
 #include "bsoid/fields/ImplicitField.hpp"
+#include "bsoid/tree/Arena.hpp"
 
 #include <vector>
+#include <algorithm>
 
 namespace bsoid
 {
@@ -15,17 +17,41 @@ namespace bsoid
         class ImplicitOperator : public fields::ImplicitField
         {
         public:
-            ImplicitOperator() = default;
+            ImplicitOperator() :
+                mFrozen(false)
+            { }
+
             virtual ~ImplicitOperator() = default;
 
-            ImplicitOperatorPtr makeEmpty() const
+            // Makes an operator of the same type with no children. When an
+            // arena is given, the operator and its list of children are
+            // allocated from it.
+            ImplicitOperatorPtr makeEmpty(tree::Arena* arena = nullptr) const
             {
-                return ImplicitOperatorPtr(cloneEmpty());
+                return cloneEmpty(arena);
             }
 
+            // The bounds are recomputed from the children on every call
+            // until they are frozen.
             atlas::utils::BBox getBBox() const override
             {
-                return box();
+                return (mFrozen) ? mBox : box();
+            }
+
+            // Caches the bounds of the operator. Nothing may be inserted
+            // into it afterwards.
+            void freezeBounds()
+            {
+                mBox = box();
+                mFrozen = true;
+            }
+
+            using FieldList = std::vector<fields::ImplicitFieldPtr,
+                tree::ArenaAllocator<fields::ImplicitFieldPtr>>;
+
+            FieldList const& getFields() const
+            {
+                return mFields;
             }
 
             void insertField(fields::ImplicitFieldPtr const& field)
@@ -52,10 +78,66 @@ namespace bsoid
                 return sdg(p);
             }
 
+            void evalBatch(fields::PointSpan const& points, 
+                float* values) const override
+            {
+                for (std::size_t i = 0; i < points.size; ++i)
+                {
+                    values[i] = eval(
+                        { points.x[i], points.y[i], points.z[i] });
+                }
+            }
+
+            // Whether the operator vanishes wherever any one of its children
+            // does. Subtrees drop such an operator as soon as one of its
+            // children is dropped.
+            virtual bool needsAllChildren() const
+            {
+                return false;
+            }
+
+            // Operators combine the bounds of their children the same way
+            // they combine values, so each of them must say how.
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override = 0;
+
         protected:
-            virtual ImplicitOperator* cloneEmpty() const = 0;
+            // Splits a batch into chunks of at most fields::batchSize points
+            // and calls fn(chunk, offset) on each of them.
+            template <typename Fn>
+            static void forEachChunk(fields::PointSpan const& points, Fn&& fn)
+            {
+                for (std::size_t offset = 0; offset < points.size; 
+                    offset += fields::batchSize)
+                {
+                    auto count = std::min(fields::batchSize, 
+                        points.size - offset);
+                    fn(points.subspan(offset, count), offset);
+                }
+            }
+
+            template <typename T>
+            static ImplicitOperatorPtr makeOperator(tree::Arena* arena)
+            {
+                if (!arena)
+                {
+                    return std::make_shared<T>();
+                }
+
+                ImplicitOperatorPtr op = arena->makeShared<T>();
+                op->mFields = FieldList(
+                    tree::ArenaAllocator<fields::ImplicitFieldPtr>(arena));
+                return op;
+            }
+
+            virtual ImplicitOperatorPtr cloneEmpty(
+                tree::Arena* arena) const = 0;
+
+            FieldList mFields;
 
-            std::vector<fields::ImplicitFieldPtr> mFields;
+        private:
+            atlas::utils::BBox mBox;
+            bool mFrozen;
         };
 
     }
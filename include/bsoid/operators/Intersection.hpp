@@ -20,6 +20,28 @@ namespace bsoid
 
             ~Intersection() = default;
 
+            void compile(fields::Program& program) const override
+            {
+                using OpCode = fields::Program::OpCode;
+
+                program.addOp(OpCode::PushHighest);
+                program.beginChildren(OpCode::Min, mFields.size());
+                for (auto& f : mFields)
+                {
+                    program.beginChild(*f);
+                    f->compile(program);
+                    program.endChild();
+                }
+                program.endChildren();
+            }
+
+            // The children are never negative, so one that is 0 takes the
+            // minimum with it.
+            bool needsAllChildren() const override
+            {
+                return true;
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 std::vector<atlas::math::Point> result;
@@ -32,6 +54,87 @@ namespace bsoid
                 return result;
             }
 
+            fields::FieldValue evalGrad(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGrad);
+            }
+
+            fields::FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGradUncounted);
+            }
+
+            void evalBatch(fields::PointSpan const& points,
+                float* values) const override
+            {
+                const float highest = atlas::core::infinity();
+                std::fill(values, values + points.size, highest);
+                forEachChunk(points, [this, values](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalBatch(chunk, field);
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            auto j = offset + i;
+                            values[j] = glm::min(values[j], field[i]);
+                        }
+                    }
+                });
+            }
+
+            void evalGradBatch(fields::PointSpan const& points, float* values,
+                fields::NormalSpan const& gradients) const override
+            {
+                const float highest = atlas::core::infinity();
+                std::fill(values, values + points.size, highest);
+                std::fill(gradients.x, gradients.x + points.size, highest);
+                std::fill(gradients.y, gradients.y + points.size, highest);
+                std::fill(gradients.z, gradients.z + points.size, highest);
+                forEachChunk(points, [this, values, &gradients](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    float gx[fields::batchSize];
+                    float gy[fields::batchSize];
+                    float gz[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalGradBatch(chunk, field, { gx, gy, gz });
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            auto j = offset + i;
+                            if (field[i] < values[j])
+                            {
+                                values[j] = field[i];
+                                gradients.x[j] = gx[i];
+                                gradients.y[j] = gy[i];
+                                gradients.z[j] = gz[i];
+                            }
+                        }
+                    }
+                });
+            }
+
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override
+            {
+                const float highest = atlas::core::infinity();
+                fields::FieldInterval result = { highest, highest };
+                for (auto& f : mFields)
+                {
+                    auto v = f->evalInterval(box);
+                    result.lo = glm::min(result.lo, v.lo);
+                    result.hi = glm::min(result.hi, v.hi);
+                }
+
+                return result;
+            }
+
         private:
             float sdf(atlas::math::Point const& p) const override
             {
@@ -46,29 +149,56 @@ namespace bsoid
 
             atlas::math::Normal sdg(atlas::math::Point const& p) const override
             {
-                atlas::math::Normal gradient(atlas::core::infinity());
+                return evalGradUncounted(p).g;
+            }
+
+            // As in Union, the gradient comes from a single child, the one
+            // with the smallest value.
+            fields::FieldValue foldGrad(atlas::math::Point const& p,
+                fields::FieldValue (fields::ImplicitField::*fn)(
+                    atlas::math::Point const&) const) const
+            {
+                fields::FieldValue result = {
+                    atlas::core::infinity(),
+                    atlas::math::Normal(atlas::core::infinity())
+                };
                 for (auto& f : mFields)
                 {
-                    gradient = glm::min(gradient, f->grad(p));
+                    auto v = ((*f).*fn)(p);
+                    if (v.value < result.value)
+                    {
+                        result = v;
+                    }
                 }
 
-                return gradient;
+                return result;
             }
 
+            // The field vanishes wherever any of the children does, so it
+            // is bounded by the overlap of their bounds.
             atlas::utils::BBox box() const override
             {
                 atlas::utils::BBox box;
+                if (mFields.empty())
+                {
+                    return box;
+                }
+
+                box = mFields.front()->getBBox();
                 for (auto& f : mFields)
                 {
-                    box = atlas::utils::join(box, f->getBBox());
+                    auto b = f->getBBox();
+                    box.pMin = glm::max(box.pMin, b.pMin);
+                    box.pMax = glm::min(box.pMax, b.pMax);
                 }
 
                 return box;
             }
 
-            Intersection* cloneEmpty() const override
+            ImplicitOperatorPtr cloneEmpty(
+                tree::Arena* arena) const override
             {
-                return new Intersection;
+                return makeOperator<Intersection>(arena);
             }
         };
     }
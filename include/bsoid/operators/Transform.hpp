@@ -22,8 +22,39 @@ namespace bsoid
                 mInverseT(glm::transpose(mInverse))
             { }
 
+            // For when the inverse is known already, such as when two
+            // transforms are composed.
+            Transform(atlas::math::Matrix4 t, atlas::math::Matrix4 inverse) :
+                mTransform(t),
+                mInverse(inverse),
+                mInverseT(glm::transpose(mInverse))
+            { }
+
             ~Transform() = default;
 
+            void compile(fields::Program& program) const override
+            {
+                if (mFields.empty())
+                {
+                    program.addOp(fields::Program::OpCode::PushZero);
+                    return;
+                }
+
+                program.pushTransform(mInverse, mInverseT);
+                mFields.front()->compile(program);
+                program.popTransform();
+            }
+
+            atlas::math::Matrix4 const& getTransform() const
+            {
+                return mTransform;
+            }
+
+            atlas::math::Matrix4 const& getInverse() const
+            {
+                return mInverse;
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 using atlas::math::Point;
@@ -39,6 +70,92 @@ namespace bsoid
                 return result;
             }
 
+            fields::FieldValue evalGrad(
+                atlas::math::Point const& p) const override
+            {
+                return transformGrad(p, &fields::ImplicitField::evalGrad);
+            }
+
+            fields::FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const override
+            {
+                return transformGrad(p,
+                    &fields::ImplicitField::evalGradUncounted);
+            }
+
+            void evalBatch(fields::PointSpan const& points,
+                float* values) const override
+            {
+                forEachChunk(points, [this, values](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float qx[fields::batchSize];
+                    float qy[fields::batchSize];
+                    float qz[fields::batchSize];
+                    fields::kernels::transformPoints(chunk, mInverse, 
+                        qx, qy, qz);
+                    mFields.front()->evalBatch({ qx, qy, qz, chunk.size },
+                        values + offset);
+                });
+            }
+
+            void evalGradBatch(fields::PointSpan const& points, float* values,
+                fields::NormalSpan const& gradients) const override
+            {
+                using atlas::math::Point;
+                using atlas::math::Point4;
+
+                forEachChunk(points, [this, values, &gradients](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float qx[fields::batchSize];
+                    float qy[fields::batchSize];
+                    float qz[fields::batchSize];
+                    fields::kernels::transformPoints(chunk, mInverse, 
+                        qx, qy, qz);
+
+                    auto g = gradients.subspan(offset);
+                    mFields.front()->evalGradBatch({ qx, qy, qz, chunk.size },
+                        values + offset, g);
+                    for (std::size_t i = 0; i < chunk.size; ++i)
+                    {
+                        auto n = fields::kernels::transformGradient(mInverseT,
+                            { g.x[i], g.y[i], g.z[i] });
+                        g.x[i] = n.x;
+                        g.y[i] = n.y;
+                        g.z[i] = n.z;
+                    }
+                });
+            }
+
+            // The child sees the box through the inverse transform, so it
+            // is given the bounds of the transformed corners.
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override
+            {
+                using atlas::math::Point;
+                using atlas::math::Point4;
+                using atlas::utils::BBox;
+                using atlas::utils::join;
+
+                if (mFields.empty())
+                {
+                    return { 0.0f, 0.0f };
+                }
+
+                BBox local;
+                for (int i = 0; i < 8; ++i)
+                {
+                    Point4 corner(
+                        (i & 4) ? box.pMax.x : box.pMin.x,
+                        (i & 2) ? box.pMax.y : box.pMin.y,
+                        (i & 1) ? box.pMax.z : box.pMin.z, 1.0f);
+                    local = join(local, Point(mInverse * corner));
+                }
+
+                return mFields.front()->evalInterval(local);
+            }
+
         private:
             float sdf(atlas::math::Point const& p) const override
             {
@@ -56,9 +173,22 @@ namespace bsoid
 
                 Point q = Point(mInverse * Point4(p, 1.0f));
                 auto grad = mFields.front()->grad(q);
-                return Point(Point4(grad, 1.0f) * mInverseT);
+                return fields::kernels::transformGradient(mInverseT, grad);
             }
             
+            fields::FieldValue transformGrad(atlas::math::Point const& p,
+                fields::FieldValue (fields::ImplicitField::*fn)(
+                    atlas::math::Point const&) const) const
+            {
+                using atlas::math::Point;
+                using atlas::math::Point4;
+
+                Point q = Point(mInverse * Point4(p, 1.0f));
+                auto v = ((*mFields.front()).*fn)(q);
+                v.g = fields::kernels::transformGradient(mInverseT, v.g);
+                return v;
+            }
+
             atlas::utils::BBox box() const override
             {
                 using atlas::math::Point;
@@ -87,9 +217,10 @@ namespace bsoid
                 return ret;
             }
 
-            Transform* cloneEmpty() const override
+            ImplicitOperatorPtr cloneEmpty(
+                tree::Arena* arena) const override
             {
-                return new Transform;
+                return makeOperator<Transform>(arena);
             }
 
             atlas::math::Matrix4 mTransform, mInverse, mInverseT;
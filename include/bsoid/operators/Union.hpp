@@ -19,6 +19,21 @@ namespace bsoid
             ~Union() = default;
 
 
+            void compile(fields::Program& program) const override
+            {
+                using OpCode = fields::Program::OpCode;
+
+                program.addOp(OpCode::PushLowest);
+                program.beginChildren(OpCode::Max, mFields.size());
+                for (auto& f : mFields)
+                {
+                    program.beginChild(*f);
+                    f->compile(program);
+                    program.endChild();
+                }
+                program.endChildren();
+            }
+
             std::vector<atlas::math::Point> getSeeds() const override
             {
                 std::vector<atlas::math::Point> result;
@@ -31,6 +46,87 @@ namespace bsoid
                 return result;
             }
 
+            fields::FieldValue evalGrad(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGrad);
+            }
+
+            fields::FieldValue evalGradUncounted(
+                atlas::math::Point const& p) const override
+            {
+                return foldGrad(p, &fields::ImplicitField::evalGradUncounted);
+            }
+
+            void evalBatch(fields::PointSpan const& points,
+                float* values) const override
+            {
+                const float lowest = -std::numeric_limits<float>::infinity();
+                std::fill(values, values + points.size, lowest);
+                forEachChunk(points, [this, values](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalBatch(chunk, field);
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            auto j = offset + i;
+                            values[j] = glm::max(values[j], field[i]);
+                        }
+                    }
+                });
+            }
+
+            void evalGradBatch(fields::PointSpan const& points, float* values,
+                fields::NormalSpan const& gradients) const override
+            {
+                const float lowest = -std::numeric_limits<float>::infinity();
+                std::fill(values, values + points.size, lowest);
+                std::fill(gradients.x, gradients.x + points.size, lowest);
+                std::fill(gradients.y, gradients.y + points.size, lowest);
+                std::fill(gradients.z, gradients.z + points.size, lowest);
+                forEachChunk(points, [this, values, &gradients](
+                    fields::PointSpan const& chunk, std::size_t offset)
+                {
+                    float field[fields::batchSize];
+                    float gx[fields::batchSize];
+                    float gy[fields::batchSize];
+                    float gz[fields::batchSize];
+                    for (auto& f : mFields)
+                    {
+                        f->evalGradBatch(chunk, field, { gx, gy, gz });
+                        for (std::size_t i = 0; i < chunk.size; ++i)
+                        {
+                            auto j = offset + i;
+                            if (field[i] > values[j])
+                            {
+                                values[j] = field[i];
+                                gradients.x[j] = gx[i];
+                                gradients.y[j] = gy[i];
+                                gradients.z[j] = gz[i];
+                            }
+                        }
+                    }
+                });
+            }
+
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const override
+            {
+                const float lowest = -std::numeric_limits<float>::infinity();
+                fields::FieldInterval result = { lowest, lowest };
+                for (auto& f : mFields)
+                {
+                    auto v = f->evalInterval(box);
+                    result.lo = glm::max(result.lo, v.lo);
+                    result.hi = glm::max(result.hi, v.hi);
+                }
+
+                return result;
+            }
+
         private:
             float sdf(atlas::math::Point const& p) const override
             {
@@ -45,13 +141,31 @@ namespace bsoid
 
             atlas::math::Normal sdg(atlas::math::Point const& p) const override
             {
-                atlas::math::Normal gradient(-std::numeric_limits<float>::infinity());
+                return evalGradUncounted(p).g;
+            }
+
+            // The gradient is that of the child with the largest value. The
+            // largest of each component on its own can come from different
+            // children, and a child with a zero gradient would then hide
+            // the negative components of the one on the surface.
+            fields::FieldValue foldGrad(atlas::math::Point const& p,
+                fields::FieldValue (fields::ImplicitField::*fn)(
+                    atlas::math::Point const&) const) const
+            {
+                fields::FieldValue result = {
+                    -std::numeric_limits<float>::infinity(),
+                    atlas::math::Normal(-std::numeric_limits<float>::infinity())
+                };
                 for (auto& f : mFields)
                 {
-                    gradient = glm::max(gradient, f->grad(p));
+                    auto v = ((*f).*fn)(p);
+                    if (v.value > result.value)
+                    {
+                        result = v;
+                    }
                 }
 
-                return gradient;
+                return result;
             }
 
             atlas::utils::BBox box() const override
@@ -65,9 +179,10 @@ namespace bsoid
                 return box;
             }
 
-            Union* cloneEmpty() const override
+            ImplicitOperatorPtr cloneEmpty(
+                tree::Arena* arena) const override
             {
-                return new Union;
+                return makeOperator<Union>(arena);
             }
         };
     }
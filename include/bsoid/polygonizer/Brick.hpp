@@ -0,0 +1,273 @@
+#ifndef BSOID_INCLUDE_BSOID_POLYGONIZER_BRICK_HPP
+#define BSOID_INCLUDE_BSOID_POLYGONIZER_BRICK_HPP
+
+#pragma once
+
+#include "Quantize.hpp"
+
+#include <atlas/math/Math.hpp>
+
+#include <array>
+#include <atomic>
+#include <memory>
+#include <cinttypes>
+
+namespace bsoid
+{
+    namespace polygonizer
+    {
+        // Number of lattice corners along each side of a brick.
+        static constexpr std::uint64_t brickSize = 8;
+        static constexpr std::uint64_t brickVolume = 
+            brickSize * brickSize * brickSize;
+
+        // The field samples for every corner in a brick. These make up the
+        // bulk of the memory of a brick, so they are allocated separately
+        // and released as soon as the owning super-voxel is finished.
+        // Gradients are only stored when they are asked for. With a codec,
+        // values are packed into 16 bits and gradients into oct-encoded
+        // directions instead.
+        struct BrickSamples
+        {
+            enum State : std::uint8_t
+            {
+                Empty = 0,
+                Writing,
+                Ready
+            };
+
+            BrickSamples(bool withGradients, SampleCodec const* sampleCodec) :
+                codec(sampleCodec)
+            {
+                for (auto& s : state)
+                {
+                    s.store(Empty, std::memory_order_relaxed);
+                }
+
+                if (codec)
+                {
+                    packedValues.reset(new std::int16_t[brickVolume]);
+                    if (withGradients)
+                    {
+                        packedGradients.reset(new std::uint16_t[brickVolume]);
+                    }
+                }
+                else
+                {
+                    values.reset(new float[brickVolume]);
+                    if (withGradients)
+                    {
+                        gradients.reset(new atlas::math::Normal[brickVolume]);
+                    }
+                }
+            }
+
+            bool hasGradients() const
+            {
+                return gradients || packedGradients;
+            }
+
+            float value(std::uint64_t idx) const
+            {
+                return (codec) ? codec->decode(packedValues[idx]) :
+                    values[idx];
+            }
+
+            atlas::math::Normal gradient(std::uint64_t idx) const
+            {
+                return (codec) ? decodeOct(packedGradients[idx]) :
+                    gradients[idx];
+            }
+
+            void set(std::uint64_t idx, float value)
+            {
+                if (codec)
+                {
+                    packedValues[idx] = codec->encode(value);
+                }
+                else
+                {
+                    values[idx] = value;
+                }
+            }
+
+            void set(std::uint64_t idx, float value,
+                atlas::math::Normal const& gradient)
+            {
+                set(idx, value);
+                if (codec)
+                {
+                    packedGradients[idx] = encodeOct(gradient);
+                }
+                else
+                {
+                    gradients[idx] = gradient;
+                }
+            }
+
+            static std::size_t bytesPerSample(bool withGradients,
+                bool compact)
+            {
+                std::size_t value = (compact) ? sizeof(std::int16_t) :
+                    sizeof(float);
+                std::size_t gradient = (compact) ? sizeof(std::uint16_t) :
+                    sizeof(atlas::math::Normal);
+                return sizeof(std::uint8_t) + value +
+                    ((withGradients) ? gradient : 0);
+            }
+
+            std::size_t size() const
+            {
+                return sizeof(BrickSamples) + brickVolume *
+                    (bytesPerSample(hasGradients(), codec != nullptr) -
+                    sizeof(std::uint8_t));
+            }
+
+            std::array<std::atomic<std::uint8_t>, brickVolume> state;
+            SampleCodec const* codec;
+            std::unique_ptr<float[]> values;
+            std::unique_ptr<atlas::math::Normal[]> gradients;
+            std::unique_ptr<std::int16_t[]> packedValues;
+            std::unique_ptr<std::uint16_t[]> packedGradients;
+        };
+
+        // A dense block of lattice corners owned by a super-voxel. Each
+        // corner also doubles as the minimum corner of a voxel, so the brick
+        // also tracks which voxels have been claimed by the march.
+        struct Brick
+        {
+            Brick() :
+                samples(nullptr)
+            {
+                for (auto& v : visited)
+                {
+                    v.store(0, std::memory_order_relaxed);
+                }
+            }
+
+            ~Brick()
+            {
+                delete samples.load();
+            }
+
+            static std::uint64_t index(std::uint64_t x, std::uint64_t y,
+                std::uint64_t z)
+            {
+                return (x * brickSize + y) * brickSize + z;
+            }
+
+            bool findSample(std::uint64_t idx, float& value) const
+            {
+                auto s = samples.load(std::memory_order_acquire);
+                if (!s || s->state[idx].load(std::memory_order_acquire) !=
+                    BrickSamples::Ready)
+                {
+                    return false;
+                }
+
+                value = s->value(idx);
+                return true;
+            }
+
+            bool findSample(std::uint64_t idx, float& value,
+                atlas::math::Normal& gradient) const
+            {
+                auto s = samples.load(std::memory_order_acquire);
+                if (!s || !s->hasGradients() || 
+                    s->state[idx].load(std::memory_order_acquire) !=
+                    BrickSamples::Ready)
+                {
+                    return false;
+                }
+
+                value = s->value(idx);
+                gradient = s->gradient(idx);
+                return true;
+            }
+
+            void storeSample(std::uint64_t idx, float value,
+                SampleCodec const* codec)
+            {
+                auto s = getSamples(false, codec);
+
+                // Only the first thread to get here writes the sample. Since
+                // the field is deterministic, anyone else computed exactly
+                // the same thing and can just carry on with their copy.
+                std::uint8_t expected = BrickSamples::Empty;
+                if (s->state[idx].compare_exchange_strong(expected,
+                    BrickSamples::Writing))
+                {
+                    s->set(idx, value);
+                    s->state[idx].store(BrickSamples::Ready,
+                        std::memory_order_release);
+                }
+            }
+
+            void storeSample(std::uint64_t idx, float value,
+                atlas::math::Normal const& gradient, SampleCodec const* codec)
+            {
+                auto s = getSamples(true, codec);
+
+                std::uint8_t expected = BrickSamples::Empty;
+                if (s->state[idx].compare_exchange_strong(expected,
+                    BrickSamples::Writing))
+                {
+                    s->set(idx, value, gradient);
+                    s->state[idx].store(BrickSamples::Ready,
+                        std::memory_order_release);
+                }
+            }
+
+            bool visitedVoxel(std::uint64_t idx) const
+            {
+                std::uint64_t bit = static_cast<std::uint64_t>(1) << (idx % 64);
+                return (visited[idx / 64].load() & bit) != 0;
+            }
+
+            bool claimVoxel(std::uint64_t idx)
+            {
+                std::uint64_t bit = static_cast<std::uint64_t>(1) << (idx % 64);
+                auto old = visited[idx / 64].fetch_or(bit);
+                return (old & bit) == 0;
+            }
+
+            std::size_t samplesSize() const
+            {
+                auto s = samples.load();
+                return (s) ? s->size() : 0;
+            }
+
+            void releaseSamples()
+            {
+                delete samples.exchange(nullptr);
+            }
+
+            // A brick either stores gradients for all of its corners or for
+            // none of them, depending on whoever allocates the samples.
+            BrickSamples* getSamples(bool withGradients,
+                SampleCodec const* codec)
+            {
+                auto s = samples.load(std::memory_order_acquire);
+                if (s)
+                {
+                    return s;
+                }
+
+                auto fresh = new BrickSamples(withGradients, codec);
+                if (samples.compare_exchange_strong(s, fresh))
+                {
+                    return fresh;
+                }
+
+                // Someone else allocated them first, so use theirs.
+                delete fresh;
+                return s;
+            }
+
+            std::atomic<BrickSamples*> samples;
+            std::array<std::atomic<std::uint64_t>, brickVolume / 64> visited;
+        };
+    }
+}
+
+#endif
@@ -5,17 +5,23 @@
 
 #include "Polygonizer.hpp"
 #include "Lattice.hpp"
-#include "SuperVoxel.hpp"
-#include "uint128_t.hpp"
+#include "SuperVoxelTree.hpp"
+#include "Cache.hpp"
+#include "Quantize.hpp"
 #include "bsoid/tree/BlobTree.hpp"
 
 #include <atlas/utils/Mesh.hpp>
 
+#include <tbb/concurrent_vector.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/flow_graph.h>
+
 #include <sstream>
 #include <string>
+#include <functional>
+#include <memory>
 #include <cinttypes>
-#include <unordered_map>
-#include <mutex>
+#include <array>
 
 namespace bsoid
 {
@@ -24,6 +30,19 @@ namespace bsoid
         class Bsoid
         {
         public:
+            // A group of triangles handed out while the mesh is being built.
+            // Every corner carries its own position and normal along with
+            // the index its vertex has in the final mesh, so batches can be
+            // used in whatever order they arrive.
+            struct TriangleBatch
+            {
+                std::vector<std::uint32_t> indices;
+                std::vector<atlas::math::Point> vertices;
+                std::vector<atlas::math::Normal> normals;
+            };
+
+            using TriangleCallback = std::function<void(TriangleBatch const&)>;
+
             Bsoid();
             Bsoid(tree::BlobTree const& model, std::string const& name,
                 float isoValue = 0.5f);
@@ -33,6 +52,11 @@ namespace bsoid
 
             void setModel(tree::BlobTree const& tree);
             void setIsoValue(float isoValue);
+            void setLazyGradients(bool lazy);
+            void setStreaming(bool streaming);
+            void setCompactCache(bool compact);
+            void setFindUnseeded(bool find);
+            void setTriangleCallback(TriangleCallback const& callback);
             void setResolution(std::uint64_t gridRes, std::uint64_t svRes);
 
             tree::BlobTree* tree() const;
@@ -55,41 +79,86 @@ namespace bsoid
             std::size_t size() const;
 
         private:
-            struct LinePoint
+            // A vertex of the mesh, kept until the mesh is assembled.
+            struct MeshPoint
             {
-                LinePoint()
-                { }
-
-                LinePoint(FieldPoint const& p) : 
-                    point(p)
-                { }
-
-                LinePoint(FieldPoint const& p, std::uint128_t const& e) :
-                    point(p),
-                    edge(e)
-                { }
+                atlas::math::Point position;
+                atlas::math::Normal normal;
+            };
 
-                FieldPoint point;
-                std::uint128_t edge;
+            // The same vertex in compact mode: the edge it lies on, how far
+            // along the edge in 1/65535ths of a cell, and its oct-encoded
+            // normal.
+            struct PackedMeshPoint
+            {
+                std::uint64_t edge;
+                std::uint16_t t;
+                std::uint16_t normal;
             };
 
-            void makeVoxels();
+            void makeVoxels(bool streaming);
+            void marchUnseeded(VoxelId const& start, VoxelId const& end,
+                std::uint64_t leafSize, bool streaming);
             void makeTriangles();
+            std::uint8_t voxelMask(Voxel const& voxel) const;
+            void findCrossings(Voxel const& voxel, std::uint8_t mask,
+                std::array<std::uint32_t, 12>& edges);
+            SurfaceVoxel makeSurfaceVoxel(Voxel const& voxel);
+            void emitVoxel(Voxel const& voxel);
+            void emitVoxel(SurfaceVoxel const& voxel);
+            void emitTriangles(std::uint8_t mask,
+                std::array<std::uint32_t, 12> const& edges);
+            void queueTriangles(std::vector<std::uint32_t> const& indices,
+                std::size_t first);
+            void flushTriangles();
 
             atlas::math::Point createCellPoint(glm::u64vec3 const& p,
                 atlas::math::Point const& delta);
             atlas::math::Point createCellPoint(std::uint64_t x,
                 std::uint64_t y, std::uint64_t z, atlas::math::Point const& delta);
 
-            FieldPoint findVoxelPoint(PointId const& id);
+            std::size_t touchedSuperVoxels(VoxelId const& id,
+                std::array<SuperVoxel*, 8>& svs);
+
+            bool findVoxelPoint(PointId const& id, FieldPoint& point);
             void fillVoxel(Voxel& v);
-            bool seenVoxel(VoxelId const& id);
+            bool findSurfacePoint(atlas::math::Point const& start,
+                atlas::math::Point& surface);
+            bool visitedVoxel(VoxelId const& id);
+            bool claimVoxel(VoxelId const& id);
+            void acquireVoxel(VoxelId const& id);
+            void releaseVoxel(VoxelId const& id);
 
             FieldPoint interpolate(FieldPoint const& p1, FieldPoint const& p2);
-            LinePoint generateLinePoint(PointId const& p1, PointId const& p2,
-                FieldPoint const& fp1, FieldPoint const& fp2);
+            std::uint32_t generateLinePoint(PointId const& p1,
+                PointId const& p2, FieldPoint const& fp1,
+                FieldPoint const& fp2);
+            std::uint32_t packLinePoint(std::uint64_t edge,
+                FieldPoint const& lo, FieldPoint const& hi);
+            atlas::math::Point edgePoint(std::uint64_t edge,
+                std::uint16_t t) const;
+            void getVertex(std::uint32_t index, atlas::math::Point& position,
+                atlas::math::Normal& normal) const;
+
+            // How the search from a seed ended: on a new part of the
+            // surface, in a component that has been marched already, or
+            // nowhere.
+            enum class SeedResult
+            {
+                Found,
+                Visited,
+                Missed
+            };
 
-            void marchVoxelOnSurface(std::vector<Voxel> const& seeds);
+            std::uint8_t getFaces(Voxel const& v) const;
+            bool probeSurface(Voxel const& v);
+            SeedResult findSurface(Voxel& v);
+            SeedResult marchSeed(Voxel const& seed, bool streaming);
+            bool marchFrom(Voxel const& v, bool streaming);
+            void marchVoxelOnSurface(std::vector<Voxel> const& seeds,
+                bool streaming);
+            void marchFrontier(tbb::concurrent_vector<VoxelId>& frontier,
+                bool streaming);
             bool validVoxel(Voxel const& v);
 
             void validateVoxels();
@@ -98,19 +167,35 @@ namespace bsoid
             atlas::math::Point mGridDelta, mSvDelta, mMin, mMax;
             std::uint64_t mGridSize, mSvSize;
             float mMagic;
-
-            std::vector<Voxel> mVoxels;
-            std::mutex mSeenVoxelsMutex;
-            std::map<std::uint64_t, VoxelId> mSeenVoxels;
-
-            std::mutex mSeenPointsMutex;
-            std::map<std::uint64_t, FieldPoint> mSeenPoints;
-
-            std::mutex mSvMutex;
-            std::unordered_map<std::uint64_t, SuperVoxel> mSuperVoxels;
-
-            std::mutex mPointMutex;
-            std::map<std::uint128_t, LinePoint> mComputedPoints;
+            bool mLazyGradients;
+            bool mStreaming;
+            bool mCompact;
+            SampleCodec mCodec;
+
+            std::vector<SurfaceVoxel> mVoxels;
+            tbb::concurrent_vector<std::uint32_t> mVoxelEdges;
+
+            SuperVoxelTree mSuperVoxels;
+
+            Cache<std::uint32_t> mComputedPoints;
+            tbb::concurrent_vector<std::uint64_t> mNewEdges;
+            std::size_t mPeakEdges;
+            std::size_t mSeedsUsed, mSeedsDuplicate, mSeedsVisited,
+                mSeedsMissed, mSeedsGenerated, mGeneratedMissed;
+            bool mFindUnseeded;
+            float mUnseededTime;
+
+            tbb::concurrent_vector<MeshPoint> mMeshPoints;
+            tbb::concurrent_vector<PackedMeshPoint> mPackedPoints;
+            tbb::enumerable_thread_specific<std::size_t> mStoredSamples;
+            tbb::enumerable_thread_specific<float> mErrorBounds;
+            tbb::enumerable_thread_specific<std::vector<std::uint32_t>>
+                mTriangles;
+
+            using BatchPointer = std::shared_ptr<TriangleBatch>;
+            TriangleCallback mTriangleCallback;
+            tbb::flow::function_node<BatchPointer>* mBatchSink;
+            tbb::enumerable_thread_specific<TriangleBatch> mPendingBatches;
 
             Lattice mLattice;
             tree::TreePointer mTree;
@@ -0,0 +1,115 @@
+#ifndef BSOID_INCLUDE_BSOID_POLYGONIZER_CACHE_HPP
+#define BSOID_INCLUDE_BSOID_POLYGONIZER_CACHE_HPP
+
+#pragma once
+
+#include <tbb/concurrent_hash_map.h>
+
+#include <cinttypes>
+
+namespace bsoid
+{
+    namespace polygonizer
+    {
+        // The ids pack the coordinates so that the low bits only hold z,
+        // which makes them terrible bucket indices on their own. Mix all the
+        // bits down before handing them to the map.
+        struct IdHashCompare
+        {
+            static std::size_t hash(std::uint64_t key)
+            {
+                key ^= key >> 33;
+                key *= 0xff51afd7ed558ccdULL;
+                key ^= key >> 33;
+                key *= 0xc4ceb9fe1a85ec53ULL;
+                key ^= key >> 33;
+                return static_cast<std::size_t>(key);
+            }
+
+            static bool equal(std::uint64_t lhs, std::uint64_t rhs)
+            {
+                return lhs == rhs;
+            }
+        };
+
+        // A thread-safe map from 64-bit ids (see Hash.hpp) to values. Other
+        // keys can be used by passing in their own HashCompare. All
+        // operations may be called concurrently. Values are immutable once
+        // inserted: the first thread to insert a key wins, and every other
+        // thread gets the winner's value back.
+        template <typename T, typename Key = std::uint64_t,
+            typename HashCompare = IdHashCompare>
+        class Cache
+        {
+        public:
+            Cache() = default;
+            ~Cache() = default;
+
+            bool find(Key const& key, T& value) const
+            {
+                typename Map::const_accessor entry;
+                if (mMap.find(entry, key))
+                {
+                    value = entry->second;
+                    return true;
+                }
+
+                return false;
+            }
+
+            T insert(Key const& key, T const& value)
+            {
+                typename Map::const_accessor entry;
+                mMap.insert(entry, typename Map::value_type(key, value));
+                return entry->second;
+            }
+
+            // Returns the value stored under the key, building it with
+            // create() the first time the key is seen. create() runs exactly
+            // once per key; any other thread asking for the same key waits
+            // until it is done. The reference stays valid until the cache is
+            // cleared.
+            template <typename Fn>
+            T const& findOrCreate(Key const& key, Fn&& create)
+            {
+                {
+                    typename Map::const_accessor entry;
+                    if (mMap.find(entry, key))
+                    {
+                        return entry->second;
+                    }
+                }
+
+                typename Map::accessor entry;
+                if (mMap.insert(entry, key))
+                {
+                    entry->second = create();
+                }
+
+                return entry->second;
+            }
+
+            std::size_t size() const
+            {
+                return mMap.size();
+            }
+
+            void erase(Key const& key)
+            {
+                mMap.erase(key);
+            }
+
+            void clear()
+            {
+                mMap.clear();
+            }
+
+        private:
+            using Map = tbb::concurrent_hash_map<Key, T, HashCompare>;
+
+            Map mMap;
+        };
+    }
+}
+
+#endif
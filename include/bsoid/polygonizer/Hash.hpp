@@ -4,11 +4,11 @@
 #pragma once
 
 #include <atlas/core/Macros.hpp>
+#include <atlas/math/Math.hpp>
 
 #include <cinttypes>
 #include <limits>
-#include "uint128_t.hpp"
-
+#include <algorithm>
 
 namespace bsoid
 {
@@ -18,25 +18,55 @@ namespace bsoid
         struct BsoidHash
         {
             static constexpr T bits = std::numeric_limits<T>::digits / 3;
-            static constexpr T mask = ~(static_cast<T>(0) << bits);
+            static constexpr T mask = ~(~static_cast<T>(0) << bits);
             static constexpr T hash(T x, T y, T z)
             {
                 return (((x & mask) << bits | (y & mask)) << bits | (z & mask));
             }
+
+            static glm::tvec3<T> unhash(T h)
+            {
+                return { (h >> (2 * bits)) & mask, (h >> bits) & mask, 
+                    h & mask };
+            }
         };
 
-        template <typename T>
-        struct BsoidEdgeHash
+        // Edges are identified by their smallest corner and the axis they run
+        // along, so both orderings of the end points map to the same id.
+        // This leaves 20 bits per coordinate and 2 bits for the axis.
+        struct BsoidEdgeHash64
         {
-            template <typename G>
-            static constexpr T hash(G h1, G h2)
+            static constexpr std::uint64_t bits = 20;
+            static constexpr std::uint64_t mask = 
+                ~(~static_cast<std::uint64_t>(0) << bits);
+
+            static std::uint64_t hash(glm::u64vec3 const& p1,
+                glm::u64vec3 const& p2)
+            {
+                std::uint64_t axis = (p1.x != p2.x) ? 0 : 
+                    ((p1.y != p2.y) ? 1 : 2);
+                std::uint64_t x = std::min(p1.x, p2.x);
+                std::uint64_t y = std::min(p1.y, p2.y);
+                std::uint64_t z = std::min(p1.z, p2.z);
+
+                return ((((x & mask) << bits | (y & mask)) << bits | 
+                    (z & mask)) << 2) | axis;
+            }
+
+            static glm::u64vec3 corner(std::uint64_t h)
+            {
+                h >>= 2;
+                return { (h >> (2 * bits)) & mask, (h >> bits) & mask,
+                    h & mask };
+            }
+
+            static std::uint64_t axis(std::uint64_t h)
             {
-                return { h1, h2 };
+                return h & 3;
             }
         };
 
         using BsoidHash64 = BsoidHash<std::uint64_t>;
-        using BsoidHash128 = BsoidEdgeHash<std::uint128_t>;
     }
 }
 
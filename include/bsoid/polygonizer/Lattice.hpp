@@ -16,7 +16,9 @@ namespace bsoid
         {
             Lattice() = default;
 
-            void makeLattice(std::vector<Voxel> const& voxels);
+            void makeLattice(std::vector<SurfaceVoxel> const& voxels,
+                atlas::math::Point const& origin,
+                atlas::math::Point const& delta);
             void clearBuffers();
 
             std::vector<atlas::math::Point> vertices;
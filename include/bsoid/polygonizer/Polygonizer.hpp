@@ -13,6 +13,7 @@ namespace bsoid
         class MarchingCubes;
         struct Lattice;
         struct Voxel;
+        struct SurfaceVoxel;
     }
 }
 
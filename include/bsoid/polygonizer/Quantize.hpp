@@ -0,0 +1,119 @@
+#ifndef BSOID_INCLUDE_BSOID_POLYGONIZER_QUANTIZE_HPP
+#define BSOID_INCLUDE_BSOID_POLYGONIZER_QUANTIZE_HPP
+
+#pragma once
+
+#include <atlas/math/Math.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cinttypes>
+
+namespace bsoid
+{
+    namespace polygonizer
+    {
+        // Stores field values as 16-bit multiples of a fixed step away from
+        // the iso-value. A value that is not on the surface never rounds to
+        // it, so every reader sees each corner on the same side of the
+        // surface as the exact value would. Values further than 32767
+        // steps from the surface are clamped.
+        struct SampleCodec
+        {
+            static constexpr std::int16_t limit = 32767;
+
+            SampleCodec(float iso = 0.5f, float s = 1.0f / 16384.0f) :
+                isoValue(iso),
+                step(s)
+            { }
+
+            std::int16_t encode(float value) const
+            {
+                float d = (value - isoValue) / step;
+                float q = std::max(-static_cast<float>(limit),
+                    std::min(static_cast<float>(limit), std::round(d)));
+                if (q == 0.0f && d != 0.0f)
+                {
+                    q = (d > 0.0f) ? 1.0f : -1.0f;
+                }
+
+                return static_cast<std::int16_t>(q);
+            }
+
+            float decode(std::int16_t q) const
+            {
+                return isoValue + static_cast<float>(q) * step;
+            }
+
+            float quantize(float value) const
+            {
+                return decode(encode(value));
+            }
+
+            static bool clamped(std::int16_t q)
+            {
+                return q == limit || q == -limit;
+            }
+
+            float isoValue;
+            float step;
+        };
+
+        // Octahedral encoding of a direction into 8 bits per coordinate.
+        // Only the direction survives, so decoding gives a unit vector.
+        inline std::uint16_t encodeOct(atlas::math::Normal const& n)
+        {
+            auto signNotZero = [](float f)
+            {
+                return (f >= 0.0f) ? 1.0f : -1.0f;
+            };
+
+            auto pack = [](float f)
+            {
+                f = std::max(-1.0f, std::min(1.0f, f));
+                return static_cast<std::uint16_t>(
+                    std::round(f * 127.5f + 127.5f));
+            };
+
+            float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+            if (l1 == 0.0f)
+            {
+                return static_cast<std::uint16_t>(pack(0.0f) << 8 |
+                    pack(0.0f));
+            }
+
+            float u = n.x / l1;
+            float v = n.y / l1;
+            if (n.z < 0.0f)
+            {
+                float pu = u;
+                u = (1.0f - std::abs(v)) * signNotZero(pu);
+                v = (1.0f - std::abs(pu)) * signNotZero(v);
+            }
+
+            return static_cast<std::uint16_t>(pack(u) << 8 | pack(v));
+        }
+
+        inline atlas::math::Normal decodeOct(std::uint16_t code)
+        {
+            auto signNotZero = [](float f)
+            {
+                return (f >= 0.0f) ? 1.0f : -1.0f;
+            };
+
+            float u = static_cast<float>(code >> 8) / 127.5f - 1.0f;
+            float v = static_cast<float>(code & 0xFF) / 127.5f - 1.0f;
+            float z = 1.0f - std::abs(u) - std::abs(v);
+            if (z < 0.0f)
+            {
+                float pu = u;
+                u = (1.0f - std::abs(v)) * signNotZero(pu);
+                v = (1.0f - std::abs(pu)) * signNotZero(v);
+            }
+
+            return glm::normalize(atlas::math::Normal(u, v, z));
+        }
+    }
+}
+
+#endif
@@ -3,11 +3,18 @@
 
 #pragma once
 
+#include "Brick.hpp"
+#include "Voxel.hpp"
 #include "bsoid/fields/ImplicitField.hpp"
 
 #include <atlas/math/Math.hpp>
 #include <atlas/utils/BBox.hpp>
+
 #include <vector>
+#include <algorithm>
+#include <memory>
+#include <atomic>
+#include <thread>
 
 namespace bsoid
 {
@@ -15,24 +22,256 @@ namespace bsoid
     {
         struct SuperVoxel
         {
-            SuperVoxel()
+            SuperVoxel() :
+                program(nullptr),
+                constant(0.0f),
+                codec(nullptr),
+                mPending(0)
             { }
 
+            SuperVoxel(SuperVoxel const&) = delete;
+            SuperVoxel& operator=(SuperVoxel const&) = delete;
+
+            ~SuperVoxel()
+            {
+                for (std::uint64_t i = 0; i < numBricks(); ++i)
+                {
+                    delete mBricks[i].load();
+                }
+            }
+
+            // The field is evaluated through the program compiled from the
+            // subtree of the cell, which is shared with every other cell
+            // that reaches the same primitives. Cells that no primitive
+            // reaches have an empty program, which is the zero field. Cells
+            // that the surface provably misses have no program at all, and
+            // every corner in them takes the same constant value, which is
+            // on the right side of the surface.
             float eval(atlas::math::Point const& p) const
             {
-                return field->eval(p);
+                return (program) ? program->eval(p) : constant;
             }
 
             atlas::math::Normal grad(atlas::math::Point const& p) const
             {
-                return field->grad(p);
+                if (!program)
+                {
+                    return atlas::math::Normal(0.0f);
+                }
+
+                return program->grad(p);
+            }
+
+            fields::FieldValue evalGrad(atlas::math::Point const& p) const
+            {
+                if (!program)
+                {
+                    return { constant, atlas::math::Normal(0.0f) };
+                }
+
+                return program->evalGrad(p);
+            }
+
+            void evalBatch(fields::PointSpan const& points, 
+                float* values) const
+            {
+                if (!program)
+                {
+                    std::fill(values, values + points.size, constant);
+                    return;
+                }
+
+                program->evalBatch(points, values);
+            }
+
+            void evalGradBatch(fields::PointSpan const& points, float* values,
+                fields::NormalSpan const& gradients) const
+            {
+                if (!program)
+                {
+                    std::fill(values, values + points.size, constant);
+                    std::fill(gradients.x, gradients.x + points.size, 0.0f);
+                    std::fill(gradients.y, gradients.y + points.size, 0.0f);
+                    std::fill(gradients.z, gradients.z + points.size, 0.0f);
+                    return;
+                }
+
+                program->evalGradBatch(points, values, gradients);
+            }
+
+            // Sets the range of lattice corners [start, start + size) that
+            // this super-voxel owns. Bricks are only allocated once a corner
+            // in them is actually touched.
+            void setCorners(PointId const& start, PointId const& size)
+            {
+                origin = start;
+                mBrickCount = (size + (brickSize - 1)) / brickSize;
+                mBricks.reset(new std::atomic<Brick*>[numBricks()]());
+            }
+
+            bool findSample(PointId const& corner, float& value) const
+            {
+                std::uint64_t idx;
+                auto brick = findBrick(corner, idx);
+                return brick && brick->findSample(idx, value);
+            }
+
+            bool findSample(PointId const& corner, float& value,
+                atlas::math::Normal& gradient) const
+            {
+                std::uint64_t idx;
+                auto brick = findBrick(corner, idx);
+                return brick && brick->findSample(idx, value, gradient);
+            }
+
+            void storeSample(PointId const& corner, float value)
+            {
+                std::uint64_t idx;
+                getBrick(corner, idx)->storeSample(idx, value, codec);
+            }
+
+            void storeSample(PointId const& corner, float value,
+                atlas::math::Normal const& gradient)
+            {
+                std::uint64_t idx;
+                getBrick(corner, idx)->storeSample(idx, value, gradient,
+                    codec);
+            }
+
+            bool visitedVoxel(VoxelId const& voxel) const
+            {
+                std::uint64_t idx;
+                auto brick = findBrick(voxel, idx);
+                return brick && brick->visitedVoxel(idx);
+            }
+
+            bool claimVoxel(VoxelId const& voxel)
+            {
+                std::uint64_t idx;
+                return getBrick(voxel, idx)->claimVoxel(idx);
+            }
+
+            // Every voxel in the frontier holds a reference on the
+            // super-voxels its corners fall in. Once the last one is
+            // released, no voxel in flight can read our samples, so they
+            // are thrown away. The visited flags are kept so that the march
+            // can never claim a voxel twice. If the frontier comes back, the
+            // samples are simply recomputed.
+            void acquire()
+            {
+                int count = mPending.load();
+                while (true)
+                {
+                    if (count < 0)
+                    {
+                        // We are being retired, wait for it to finish.
+                        std::this_thread::yield();
+                        count = mPending.load();
+                        continue;
+                    }
+
+                    if (mPending.compare_exchange_weak(count, count + 1))
+                    {
+                        return;
+                    }
+                }
+            }
+
+            void release()
+            {
+                if (mPending.fetch_sub(1) != 1)
+                {
+                    return;
+                }
+
+                int expected = 0;
+                if (mPending.compare_exchange_strong(expected, -1))
+                {
+                    for (std::uint64_t i = 0; i < numBricks(); ++i)
+                    {
+                        auto brick = mBricks[i].load();
+                        if (brick)
+                        {
+                            brick->releaseSamples();
+                        }
+                    }
+                    mPending.store(0);
+                }
+            }
+
+            std::size_t size() const
+            {
+                std::size_t total = sizeof(SuperVoxel) + 
+                    numBricks() * sizeof(std::atomic<Brick*>);
+                for (std::uint64_t i = 0; i < numBricks(); ++i)
+                {
+                    auto brick = mBricks[i].load();
+                    if (brick)
+                    {
+                        total += sizeof(Brick) + brick->samplesSize();
+                    }
+                }
+
+                return total;
             }
 
-            glm::u64vec3 id;
-            fields::ImplicitFieldPtr field;
+            std::uint64_t id;
+            fields::Program const* program;
+            float constant;
+
+            // How the samples are stored. Without a codec they are kept
+            // exactly.
+            SampleCodec const* codec;
             atlas::utils::BBox cell;
+            PointId origin;
+
+        private:
+            std::uint64_t numBricks() const
+            {
+                return mBrickCount.x * mBrickCount.y * mBrickCount.z;
+            }
+
+            std::uint64_t locate(PointId const& corner,
+                std::uint64_t& idx) const
+            {
+                auto local = corner - origin;
+                auto b = local / brickSize;
+                auto c = local - b * brickSize;
+                idx = Brick::index(c.x, c.y, c.z);
+                return (b.x * mBrickCount.y + b.y) * mBrickCount.z + b.z;
+            }
+
+            Brick* findBrick(PointId const& corner, std::uint64_t& idx) const
+            {
+                return mBricks[locate(corner, idx)].load();
+            }
+
+            Brick* getBrick(PointId const& corner, std::uint64_t& idx)
+            {
+                auto& slot = mBricks[locate(corner, idx)];
+                auto brick = slot.load();
+                if (brick)
+                {
+                    return brick;
+                }
+
+                auto fresh = new Brick;
+                if (slot.compare_exchange_strong(brick, fresh))
+                {
+                    return fresh;
+                }
+
+                delete fresh;
+                return brick;
+            }
+
+            glm::u64vec3 mBrickCount;
+            std::unique_ptr<std::atomic<Brick*>[]> mBricks;
+            std::atomic<int> mPending;
         };
+
+        using SuperVoxelPtr = std::unique_ptr<SuperVoxel>;
     }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,136 @@
+#ifndef BSOID_INCLUDE_BSOID_POLYGONIZER_SUPER_VOXEL_TREE_HPP
+#define BSOID_INCLUDE_BSOID_POLYGONIZER_SUPER_VOXEL_TREE_HPP
+
+#pragma once
+
+#include "SuperVoxel.hpp"
+#include "Cache.hpp"
+#include "bsoid/tree/BlobTree.hpp"
+
+#include <atlas/math/Math.hpp>
+
+#include <tbb/concurrent_vector.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+namespace bsoid
+{
+    namespace polygonizer
+    {
+        // An octree over the lattice corners [0, gridSize] whose leaves are
+        // the super-voxels. A cell stops being split once the part of the
+        // BlobTree that reaches it is empty, has at most maxLeaves
+        // primitives, or the cell has reached the minimum size. Dense
+        // clusters of primitives therefore end up in small super-voxels and
+        // empty or sparse space in large ones.
+        //
+        // The octree is expanded lazily: the children of a cell are only
+        // built the first time a corner inside them is looked up, so only
+        // the cells that the surface actually reaches are ever created.
+        //
+        // Neighbouring cells usually reach the same primitives, so their
+        // subtrees are interned by the nodes of the BlobTree that they
+        // visit: each distinct subtree is built and compiled once, and all
+        // the super-voxels that reach it share its program. The subtrees
+        // are allocated from an arena that lives as long as the octree, and
+        // is dropped in one go by clear().
+        //
+        // Before a leaf is handed its program, its subtree is bounded over
+        // the cell. If the bounds exclude the iso-value, the surface cannot
+        // cross any edge the cell owns, and the leaf is pruned: its corners
+        // all take one constant value on the correct side of the surface
+        // and the field is never evaluated there.
+        class SuperVoxelTree
+        {
+        public:
+            SuperVoxelTree();
+            ~SuperVoxelTree();
+
+            SuperVoxelTree(SuperVoxelTree const&) = delete;
+            SuperVoxelTree& operator=(SuperVoxelTree const&) = delete;
+
+            void makeTree(tree::BlobTree const* blobTree,
+                atlas::math::Point const& origin,
+                atlas::math::Point const& delta, std::uint64_t gridSize,
+                std::uint64_t minCellSize, std::size_t maxLeaves,
+                float isoValue, SampleCodec const* codec = nullptr);
+            void clear();
+
+            SuperVoxel& find(PointId const& corner);
+            SuperVoxel& operator[](std::uint64_t index);
+
+            std::size_t numSuperVoxels() const;
+            std::size_t numSubTrees() const;
+            std::size_t subTreeLookups() const;
+            std::size_t subTreeHits() const;
+            std::size_t numPruned() const;
+            std::size_t size() const;
+
+        private:
+            struct Cell
+            {
+                PointId start, end;
+                SuperVoxel* superVoxel;
+                std::array<std::once_flag, 8> childFlags;
+                std::array<std::unique_ptr<Cell>, 8> children;
+            };
+
+            struct SubTree
+            {
+                fields::ImplicitFieldPtr field;
+                fields::Program program;
+            };
+
+            using SubTreeKey = std::vector<tree::Node const*>;
+
+            struct SubTreeHashCompare
+            {
+                static std::size_t hash(SubTreeKey const& key)
+                {
+                    std::size_t h = key.size();
+                    for (auto node : key)
+                    {
+                        h ^= std::hash<tree::Node const*>()(node) +
+                            0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+                    }
+
+                    return h;
+                }
+
+                static bool equal(SubTreeKey const& lhs, 
+                    SubTreeKey const& rhs)
+                {
+                    return lhs == rhs;
+                }
+            };
+
+            std::unique_ptr<Cell> makeCell(PointId const& start,
+                PointId const& end);
+            Cell& getChild(Cell& cell, std::uint64_t child);
+            SubTree const& findSubTree(SubTreeKey const& key,
+                atlas::utils::BBox const& box);
+
+            tree::BlobTree const* mBlobTree;
+            atlas::math::Point mOrigin, mDelta;
+            std::uint64_t mMinCellSize;
+            std::size_t mMaxLeaves;
+            float mIsoValue;
+            SampleCodec const* mCodec;
+
+            tree::Arena mArena;
+            Cache<std::unique_ptr<SubTree>, SubTreeKey, SubTreeHashCompare>
+                mSubTrees;
+            std::atomic<std::size_t> mLookups, mMisses, mSubTreesSize;
+            std::atomic<std::size_t> mPruned;
+
+            std::unique_ptr<Cell> mRoot;
+            tbb::concurrent_vector<SuperVoxelPtr> mSuperVoxels;
+        };
+    }
+}
+
+#endif
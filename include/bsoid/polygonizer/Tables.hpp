@@ -34,36 +34,43 @@ namespace bsoid
             {  0, -1,  0 }
         };
 
-        const std::vector<glm::ivec2> EdgeDecals = 
+        // For every voxel configuration, the faces of the voxel that the
+        // surface crosses, as a bit mask of indices into NeighbourDecals. A
+        // face is crossed when any of its four edges is.
+        constexpr std::uint8_t NeighbourFaceTable[256] =
         {
-            { 0, 1 },
-            { 1, 2 }, 
-            { 2, 3 },
-            { 3, 0 },
-            { 4, 5 }, 
-            { 5, 6 }, 
-            { 6, 7 },
-            { 7, 0 },
-            { 0, 4 },
-            { 1, 5 },
-            { 2, 6 },
-            { 3, 7 }
-        };
-
-        const std::vector<std::vector<int>> NeighbourMap
-        {
-            { 0, 5 },
-            { 1, 5 },
-            { 2, 5 },
-            { 3, 5 },
-            { 0, 4 },
-            { 1, 4 },
-            { 2, 4 },
-            { 3, 4 },
-            { 0, 3 },
-            { 0, 1 },
-            { 1, 2 },
-            { 2, 3 }
+            0x00, 0x29, 0x23, 0x2b, 0x26, 0x2f, 0x27, 0x2f,
+            0x2c, 0x2d, 0x2f, 0x2f, 0x2e, 0x2f, 0x2f, 0x0f,
+            0x19, 0x39, 0x3b, 0x3b, 0x3f, 0x3f, 0x3f, 0x3f,
+            0x3d, 0x3d, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x1f,
+            0x13, 0x3b, 0x33, 0x3b, 0x37, 0x3f, 0x37, 0x3f,
+            0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x1f,
+            0x1b, 0x3b, 0x3b, 0x3a, 0x3f, 0x3f, 0x3f, 0x3e,
+            0x3f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x1e,
+            0x16, 0x3f, 0x37, 0x3f, 0x36, 0x3f, 0x37, 0x3f,
+            0x3e, 0x3f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x1f,
+            0x1f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,
+            0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x1f,
+            0x17, 0x3f, 0x37, 0x3f, 0x37, 0x3f, 0x35, 0x3d,
+            0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3d, 0x1d,
+            0x1f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3d, 0x3c,
+            0x3f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3d, 0x1c,
+            0x1c, 0x3d, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f,
+            0x3c, 0x3d, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x1f,
+            0x1d, 0x3d, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,
+            0x3d, 0x35, 0x3f, 0x37, 0x3f, 0x37, 0x3f, 0x17,
+            0x1f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,
+            0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x1f,
+            0x1f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f, 0x3e,
+            0x3f, 0x37, 0x3f, 0x36, 0x3f, 0x37, 0x3f, 0x16,
+            0x1e, 0x3f, 0x3f, 0x3f, 0x3e, 0x3f, 0x3f, 0x3f,
+            0x3e, 0x3f, 0x3f, 0x3f, 0x3a, 0x3b, 0x3b, 0x1b,
+            0x1f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f,
+            0x3f, 0x37, 0x3f, 0x37, 0x3b, 0x33, 0x3b, 0x13,
+            0x1f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3d, 0x3d,
+            0x3f, 0x3f, 0x3f, 0x3f, 0x3b, 0x3b, 0x39, 0x19,
+            0x0f, 0x2f, 0x2f, 0x2e, 0x2f, 0x2f, 0x2d, 0x2c,
+            0x2f, 0x27, 0x2f, 0x26, 0x2b, 0x23, 0x29, 0x00
         };
 
         constexpr std::uint32_t EdgeTable[256] =
@@ -36,14 +36,14 @@ namespace bsoid
                 atlas::math::Normal const& grad) :
                 value(p, v),
                 g(grad),
-                svHash(0)
+                svIndex(0)
             { }
 
             FieldPoint(atlas::math::Point const& p, float v, 
-                atlas::math::Normal const& grad, std::uint64_t id) :
+                atlas::math::Normal const& grad, std::uint32_t id) :
                 value(p, v),
                 g(grad),
-                svHash(id)
+                svIndex(id)
             { }
 
             bool operator==(FieldPoint const& rhs) const
@@ -58,7 +58,7 @@ namespace bsoid
 
             atlas::math::Point4 value;
             atlas::math::Normal g;
-            std::uint64_t svHash;
+            std::uint32_t svIndex;
         };
 
         constexpr auto invalidUint()
@@ -92,6 +92,18 @@ namespace bsoid
             std::array<FieldPoint, 8> points;
             VoxelId id;
         };
+
+        // What is kept of a voxel on the surface once the march has moved
+        // past it. The id is packed into 64 bits, the mask has one bit per
+        // corner that is inside the surface, and the mesh indices of the
+        // crossed edges sit in a pool shared by all voxels, starting at
+        // firstEdge and stored in the order of the edges in EdgeTable.
+        struct SurfaceVoxel
+        {
+            std::uint64_t id;
+            std::uint32_t firstEdge;
+            std::uint8_t mask;
+        };
     }
 }
 
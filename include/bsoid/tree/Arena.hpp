@@ -0,0 +1,127 @@
+#ifndef BSOID_INCLUDE_BSOID_TREE_ARENA_HPP
+#define BSOID_INCLUDE_BSOID_TREE_ARENA_HPP
+
+#pragma once
+
+#include <tbb/enumerable_thread_specific.h>
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+
+namespace bsoid
+{
+    namespace tree
+    {
+        // A monotonic allocator for the fields built during a single
+        // polygonization. Every thread bumps a pointer through its own
+        // blocks, so allocating never takes a lock. Nothing is handed back
+        // until release() drops all of the blocks at once, which must not
+        // race with any allocation, and must come after every object in the
+        // arena has been destroyed.
+        class Arena
+        {
+        public:
+            Arena(std::size_t blockSize = 64 * 1024);
+            ~Arena() = default;
+
+            Arena(Arena const&) = delete;
+            Arena& operator=(Arena const&) = delete;
+
+            void* allocate(std::size_t size, std::size_t alignment);
+            void release();
+
+            std::size_t size() const;
+
+            // Like std::make_shared, but the object and its control block
+            // both live in the arena.
+            template <typename T, typename... Args>
+            std::shared_ptr<T> makeShared(Args&&... args);
+
+        private:
+            struct Block
+            {
+                std::unique_ptr<char[]> data;
+                std::size_t size, used;
+            };
+
+            std::size_t mBlockSize;
+            tbb::enumerable_thread_specific<std::vector<Block>> mBlocks;
+        };
+
+        // A standard allocator over an arena. Without an arena it falls back
+        // to the global heap, so containers can be given an arena only when
+        // one is around.
+        template <typename T>
+        class ArenaAllocator
+        {
+        public:
+            using value_type = T;
+
+            // Containers that are moved or swapped take the allocator of the
+            // source with them, so their memory never ends up freed through
+            // the wrong one.
+            using propagate_on_container_move_assignment = std::true_type;
+            using propagate_on_container_swap = std::true_type;
+
+            ArenaAllocator(Arena* arena = nullptr) :
+                mArena(arena)
+            { }
+
+            template <typename U>
+            ArenaAllocator(ArenaAllocator<U> const& other) :
+                mArena(other.arena())
+            { }
+
+            T* allocate(std::size_t n)
+            {
+                if (mArena)
+                {
+                    return static_cast<T*>(
+                        mArena->allocate(n * sizeof(T), alignof(T)));
+                }
+
+                return static_cast<T*>(::operator new(n * sizeof(T)));
+            }
+
+            void deallocate(T* p, std::size_t)
+            {
+                if (!mArena)
+                {
+                    ::operator delete(p);
+                }
+            }
+
+            Arena* arena() const
+            {
+                return mArena;
+            }
+
+        private:
+            Arena* mArena;
+        };
+
+        template <typename T, typename U>
+        bool operator==(ArenaAllocator<T> const& a,
+            ArenaAllocator<U> const& b)
+        {
+            return a.arena() == b.arena();
+        }
+
+        template <typename T, typename U>
+        bool operator!=(ArenaAllocator<T> const& a,
+            ArenaAllocator<U> const& b)
+        {
+            return !(a == b);
+        }
+
+        template <typename T, typename... Args>
+        std::shared_ptr<T> Arena::makeShared(Args&&... args)
+        {
+            return std::allocate_shared<T>(ArenaAllocator<T>(this),
+                std::forward<Args>(args)...);
+        }
+    }
+}
+
+#endif
@@ -5,8 +5,10 @@
 
 #include "Tree.hpp"
 #include "Node.hpp"
+#include "SubTreeIndex.hpp"
 #include "bsoid/fields/ImplicitField.hpp"
 
+#include <memory>
 #include <vector>
 
 namespace bsoid
@@ -30,21 +32,61 @@ namespace bsoid
             void insertNodeTree(std::vector<std::vector<int>> const& tree);
             void insertFieldTree(fields::ImplicitFieldPtr const& tree);
 
+            // Rewrites the tree into one that evaluates the same field more
+            // cheaply. Chains of transforms are composed into one, nested
+            // operators of the same kind are merged, operators with a single
+            // child are dropped, and the bounds of every operator are
+            // cached. The fields that were inserted are left untouched, so
+            // this must come after the tree is complete, and nothing may be
+            // inserted afterwards.
+            void freeze();
+
+            // These only evaluate the subtree that covers the cell of the
+            // point, which is compiled the first time the cell is used.
             float eval(atlas::math::Point const& p) const;
             atlas::math::Normal grad(atlas::math::Point const& p) const;
+            fields::FieldValue evalGrad(atlas::math::Point const& p) const;
+
+            // Evaluates each run of consecutive points that fall in the same
+            // cell with that cell's subtree, so coherent batches such as the
+            // rows of a grid get the same locality as single points.
+            void evalPoints(fields::PointSpan const& points,
+                float* values) const;
+
+            // Evaluates the whole tree over the batch.
+            void evalBatch(fields::PointSpan const& points, 
+                float* values) const;
+            fields::FieldInterval evalInterval(
+                atlas::utils::BBox const& box) const;
 
             fields::ImplicitFieldPtr getSubTree(
                 atlas::utils::BBox const& box) const;
+            fields::ImplicitFieldPtr getSubTree(atlas::utils::BBox const& box,
+                std::size_t& numLeaves, Arena* arena = nullptr) const;
+            std::size_t getSubTreeNodes(atlas::utils::BBox const& box,
+                std::vector<Node const*>& nodes) const;
 
             atlas::utils::BBox getTreeBox() const;
             std::vector<atlas::math::Point> getSeeds() const;
 
             std::string getFieldSummary() const;
 
+            // Evaluates a grid of samples x samples x samples points over the
+            // bounds of the tree with the subtrees of an index of the given
+            // resolution, and returns how many of them differ from the
+            // whole tree. They should all be the same.
+            std::size_t validateIndex(int resolution,
+                std::size_t samples) const;
+
         private:
+            fields::Program const& localProgram(
+                atlas::math::Point const& p) const;
+
             std::vector<NodePtr> mNodes;
             NodePtr mVolumeTree;
             fields::ImplicitFieldPtr mFieldTree;
+            fields::Program mProgram;
+            std::shared_ptr<SubTreeIndex> mIndex;
             std::vector<fields::ImplicitFieldPtr> mSkeletalFields;
         };
     }
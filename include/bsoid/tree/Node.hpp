@@ -4,6 +4,7 @@
 #pragma once
 
 #include "Tree.hpp"
+#include "Arena.hpp"
 #include "bsoid/fields/ImplicitField.hpp"
 
 #include <vector>
@@ -20,6 +21,7 @@ namespace bsoid
             ~Node() = default;
 
             void setField(fields::ImplicitFieldPtr const& field);
+            fields::ImplicitFieldPtr getField() const;
             atlas::utils::BBox getBBox() const;
 
             void addChild(NodePtr const& child);
@@ -31,6 +33,15 @@ namespace bsoid
 
             fields::ImplicitFieldPtr subTree(
                 atlas::utils::BBox const& cell) const;
+            fields::ImplicitFieldPtr subTree(atlas::utils::BBox const& cell,
+                std::size_t& numLeaves, Arena* arena = nullptr) const;
+
+            // Appends the nodes that subTree(cell) would visit to nodes, in
+            // the order it visits them, and returns the number of leaves
+            // among them. Two cells with the same nodes have the same
+            // subtree.
+            std::size_t collect(atlas::utils::BBox const& cell,
+                std::vector<Node const*>& nodes) const;
 
         private:
             fields::ImplicitFieldPtr mField;
@@ -0,0 +1,74 @@
+#ifndef BSOID_INCLUDE_BSOID_TREE_SUB_TREE_INDEX_HPP
+#define BSOID_INCLUDE_BSOID_TREE_SUB_TREE_INDEX_HPP
+
+#pragma once
+
+#include "Tree.hpp"
+#include "Node.hpp"
+#include "bsoid/fields/Program.hpp"
+
+#include <atlas/utils/BBox.hpp>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace bsoid
+{
+    namespace tree
+    {
+        // A uniform grid over the bounds of a volume tree, each cell of
+        // which holds the program for the subtree that covers it. Programs
+        // are compiled the first time a point in their cell is looked up,
+        // and cells that cover the same nodes share one. Lookups may be made
+        // concurrently.
+        class SubTreeIndex
+        {
+        public:
+            // A resolution of 0 picks one from the number of leaves.
+            SubTreeIndex(NodePtr const& root, int resolution = 0);
+            ~SubTreeIndex() = default;
+
+            SubTreeIndex(SubTreeIndex const&) = delete;
+            SubTreeIndex& operator=(SubTreeIndex const&) = delete;
+
+            // Returns the cell that contains p, or npos if p is outside the
+            // grid.
+            std::size_t findCell(atlas::math::Point const& p) const;
+            fields::Program const& getProgram(std::size_t cell) const;
+
+            std::size_t numSubTrees() const;
+
+            static constexpr std::size_t npos = ~std::size_t(0);
+
+        private:
+            struct SubTree
+            {
+                fields::ImplicitFieldPtr field;
+                fields::Program program;
+            };
+
+            using SubTreeKey = std::vector<Node const*>;
+
+            struct SubTreeHash
+            {
+                std::size_t operator()(SubTreeKey const& key) const;
+            };
+
+            SubTree const& makeSubTree(std::size_t cell) const;
+
+            NodePtr mRoot;
+            atlas::math::Point mOrigin, mLimit, mCellSize;
+            int mDims[3];
+
+            mutable std::unique_ptr<std::atomic<SubTree const*>[]> mCells;
+            mutable std::mutex mMutex;
+            mutable std::unordered_map<SubTreeKey, std::unique_ptr<SubTree>,
+                SubTreeHash> mSubTrees;
+        };
+    }
+}
+
+#endif
@@ -0,0 +1,506 @@
+#include "bsoid/fields/Kernels.hpp"
+#include "bsoid/fields/Filters.hpp"
+
+#include <cmath>
+
+// Contraction into fused multiply-adds is turned off in the vector kernels so
+// that they round exactly like the scalar code.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BSOID_KERNELS_X86 1
+#if defined(__clang__)
+// Clang has no optimize attribute, so contraction is turned off for the
+// whole file instead.
+#pragma clang fp contract(off)
+#define BSOID_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BSOID_TARGET(isa) \
+    __attribute__((target(isa), optimize("fp-contract=off")))
+#endif
+#include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define BSOID_KERNELS_X86 1
+#define BSOID_TARGET(isa)
+#include <immintrin.h>
+#include <intrin.h>
+#else
+#define BSOID_KERNELS_X86 0
+#endif
+
+namespace bsoid
+{
+    namespace fields
+    {
+        namespace kernels
+        {
+            namespace
+            {
+                enum class Isa
+                {
+                    Scalar,
+                    Avx2,
+                    Avx512
+                };
+
+                Isa detectIsa()
+                {
+#if defined(__GNUC__) && BSOID_KERNELS_X86
+                    __builtin_cpu_init();
+                    if (__builtin_cpu_supports("avx512f"))
+                    {
+                        return Isa::Avx512;
+                    }
+
+                    if (__builtin_cpu_supports("avx2"))
+                    {
+                        return Isa::Avx2;
+                    }
+#elif defined(_MSC_VER) && BSOID_KERNELS_X86
+                    int info[4];
+                    __cpuid(info, 0);
+                    if (info[0] < 7)
+                    {
+                        return Isa::Scalar;
+                    }
+
+                    // Make sure the OS saves the wide registers before we
+                    // go anywhere near them.
+                    __cpuid(info, 1);
+                    bool osxsave = (info[2] & (1 << 27)) != 0;
+                    bool avx = (info[2] & (1 << 28)) != 0;
+                    if (!osxsave || !avx)
+                    {
+                        return Isa::Scalar;
+                    }
+
+                    auto xcr0 = _xgetbv(0);
+                    __cpuidex(info, 7, 0);
+                    if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6)
+                    {
+                        return Isa::Avx512;
+                    }
+
+                    if ((info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6)
+                    {
+                        return Isa::Avx2;
+                    }
+#endif
+                    return Isa::Scalar;
+                }
+
+                Isa getIsa()
+                {
+                    static const Isa isa = detectIsa();
+                    return isa;
+                }
+
+                //=============================================================
+                // Scalar.
+                //=============================================================
+                // These mirror the order of operations of the glm code in
+                // the fields exactly, so every variant rounds the same way.
+                void compactFieldScalar(float const* dist, float* out,
+                    std::size_t n)
+                {
+                    for (std::size_t i = 0; i < n; ++i)
+                    {
+                        out[i] = fields::compactField(dist[i]);
+                    }
+                }
+
+                void sphereSdfScalar(PointSpan const& points,
+                    atlas::math::Point const& centre, float radius,
+                    float* out, std::size_t start)
+                {
+                    for (std::size_t i = start; i < points.size; ++i)
+                    {
+                        float dx = points.x[i] - centre.x;
+                        float dy = points.y[i] - centre.y;
+                        float dz = points.z[i] - centre.z;
+                        out[i] = std::sqrt(dx * dx + dy * dy + dz * dz) -
+                            radius;
+                    }
+                }
+
+                void torusSdfScalar(PointSpan const& points,
+                    atlas::math::Point const& centre, float c, float a,
+                    float* out, std::size_t start)
+                {
+                    for (std::size_t i = start; i < points.size; ++i)
+                    {
+                        float dx = points.x[i] - centre.x;
+                        float dy = points.y[i] - centre.y;
+                        float dz = points.z[i] - centre.z;
+                        float root = std::sqrt(dx * dx + dy * dy);
+                        float left = (c - root) * (c - root);
+                        out[i] = left + dz * dz - (a * a);
+                    }
+                }
+
+                void transformPointsScalar(PointSpan const& points,
+                    atlas::math::Matrix4 const& m, float* x, float* y,
+                    float* z, std::size_t start)
+                {
+                    for (std::size_t i = start; i < points.size; ++i)
+                    {
+                        float px = points.x[i];
+                        float py = points.y[i];
+                        float pz = points.z[i];
+                        x[i] = (m[0][0] * px + m[1][0] * py) +
+                            (m[2][0] * pz + m[3][0]);
+                        y[i] = (m[0][1] * px + m[1][1] * py) +
+                            (m[2][1] * pz + m[3][1]);
+                        z[i] = (m[0][2] * px + m[1][2] * py) +
+                            (m[2][2] * pz + m[3][2]);
+                    }
+                }
+
+#if BSOID_KERNELS_X86
+                //=============================================================
+                // AVX2.
+                //=============================================================
+                BSOID_TARGET("avx2")
+                void compactFieldAvx2(float const* dist, float* out,
+                    std::size_t n)
+                {
+                    const __m256 one = _mm256_set1_ps(1.0f);
+                    const __m256 zero = _mm256_setzero_ps();
+                    const __m256 r = _mm256_set1_ps(radius);
+                    const __m256 nr = _mm256_set1_ps(-radius);
+                    const __m256 A = _mm256_set1_ps(-3.0f / 16);
+                    const __m256 B = _mm256_set1_ps(5.0f / 8);
+                    const __m256 C = _mm256_set1_ps(15.0f / 16.0f);
+                    const __m256 D = _mm256_set1_ps(0.5f);
+
+                    std::size_t i = 0;
+                    for (; i + 8 <= n; i += 8)
+                    {
+                        __m256 d = _mm256_loadu_ps(dist + i);
+                        __m256 x = _mm256_div_ps(d, r);
+                        __m256 x3 = _mm256_mul_ps(_mm256_mul_ps(x, x), x);
+                        __m256 x5 = _mm256_mul_ps(_mm256_mul_ps(x3, x), x);
+                        __m256 f = _mm256_add_ps(_mm256_sub_ps(
+                            _mm256_add_ps(_mm256_mul_ps(A, x5),
+                                _mm256_mul_ps(B, x3)),
+                            _mm256_mul_ps(C, x)), D);
+
+                        f = _mm256_blendv_ps(f, zero,
+                            _mm256_cmp_ps(d, r, _CMP_GT_OQ));
+                        f = _mm256_blendv_ps(f, one,
+                            _mm256_cmp_ps(d, nr, _CMP_LT_OQ));
+                        _mm256_storeu_ps(out + i, f);
+                    }
+
+                    compactFieldScalar(dist + i, out + i, n - i);
+                }
+
+                BSOID_TARGET("avx2")
+                void sphereSdfAvx2(PointSpan const& points,
+                    atlas::math::Point const& centre, float radius,
+                    float* out)
+                {
+                    const __m256 cx = _mm256_set1_ps(centre.x);
+                    const __m256 cy = _mm256_set1_ps(centre.y);
+                    const __m256 cz = _mm256_set1_ps(centre.z);
+                    const __m256 r = _mm256_set1_ps(radius);
+
+                    std::size_t i = 0;
+                    for (; i + 8 <= points.size; i += 8)
+                    {
+                        __m256 dx = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.x + i), cx);
+                        __m256 dy = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.y + i), cy);
+                        __m256 dz = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.z + i), cz);
+                        __m256 len = _mm256_add_ps(_mm256_add_ps(
+                            _mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)),
+                            _mm256_mul_ps(dz, dz));
+                        _mm256_storeu_ps(out + i,
+                            _mm256_sub_ps(_mm256_sqrt_ps(len), r));
+                    }
+
+                    sphereSdfScalar(points, centre, radius, out, i);
+                }
+
+                BSOID_TARGET("avx2")
+                void torusSdfAvx2(PointSpan const& points,
+                    atlas::math::Point const& centre, float c, float a,
+                    float* out)
+                {
+                    const __m256 cx = _mm256_set1_ps(centre.x);
+                    const __m256 cy = _mm256_set1_ps(centre.y);
+                    const __m256 cz = _mm256_set1_ps(centre.z);
+                    const __m256 vc = _mm256_set1_ps(c);
+                    const __m256 a2 = _mm256_set1_ps(a * a);
+
+                    std::size_t i = 0;
+                    for (; i + 8 <= points.size; i += 8)
+                    {
+                        __m256 dx = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.x + i), cx);
+                        __m256 dy = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.y + i), cy);
+                        __m256 dz = _mm256_sub_ps(
+                            _mm256_loadu_ps(points.z + i), cz);
+                        __m256 root = _mm256_sqrt_ps(_mm256_add_ps(
+                            _mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+                        __m256 l = _mm256_sub_ps(vc, root);
+                        __m256 sum = _mm256_add_ps(_mm256_mul_ps(l, l),
+                            _mm256_mul_ps(dz, dz));
+                        _mm256_storeu_ps(out + i, _mm256_sub_ps(sum, a2));
+                    }
+
+                    torusSdfScalar(points, centre, c, a, out, i);
+                }
+
+                BSOID_TARGET("avx2")
+                void transformPointsAvx2(PointSpan const& points,
+                    atlas::math::Matrix4 const& m, float* x, float* y,
+                    float* z)
+                {
+                    float* outs[] = { x, y, z };
+                    std::size_t i = 0;
+                    for (; i + 8 <= points.size; i += 8)
+                    {
+                        __m256 px = _mm256_loadu_ps(points.x + i);
+                        __m256 py = _mm256_loadu_ps(points.y + i);
+                        __m256 pz = _mm256_loadu_ps(points.z + i);
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            __m256 lo = _mm256_add_ps(
+                                _mm256_mul_ps(_mm256_set1_ps(m[0][k]), px),
+                                _mm256_mul_ps(_mm256_set1_ps(m[1][k]), py));
+                            __m256 hi = _mm256_add_ps(
+                                _mm256_mul_ps(_mm256_set1_ps(m[2][k]), pz),
+                                _mm256_set1_ps(m[3][k]));
+                            _mm256_storeu_ps(outs[k] + i,
+                                _mm256_add_ps(lo, hi));
+                        }
+                    }
+
+                    transformPointsScalar(points, m, x, y, z, i);
+                }
+
+                //=============================================================
+                // AVX-512.
+                //=============================================================
+                // The tail of each batch is handled with masked loads and
+                // stores instead of falling back to scalar code.
+                BSOID_TARGET("avx512f")
+                __mmask16 tailMask(std::size_t remaining)
+                {
+                    return (remaining >= 16) ? static_cast<__mmask16>(0xffff) :
+                        static_cast<__mmask16>((1u << remaining) - 1);
+                }
+
+                BSOID_TARGET("avx512f")
+                void compactFieldAvx512(float const* dist, float* out,
+                    std::size_t n)
+                {
+                    const __m512 one = _mm512_set1_ps(1.0f);
+                    const __m512 zero = _mm512_setzero_ps();
+                    const __m512 r = _mm512_set1_ps(radius);
+                    const __m512 nr = _mm512_set1_ps(-radius);
+                    const __m512 A = _mm512_set1_ps(-3.0f / 16);
+                    const __m512 B = _mm512_set1_ps(5.0f / 8);
+                    const __m512 C = _mm512_set1_ps(15.0f / 16.0f);
+                    const __m512 D = _mm512_set1_ps(0.5f);
+
+                    for (std::size_t i = 0; i < n; i += 16)
+                    {
+                        auto mask = tailMask(n - i);
+                        __m512 d = _mm512_maskz_loadu_ps(mask, dist + i);
+                        __m512 x = _mm512_div_ps(d, r);
+                        __m512 x3 = _mm512_mul_ps(_mm512_mul_ps(x, x), x);
+                        __m512 x5 = _mm512_mul_ps(_mm512_mul_ps(x3, x), x);
+                        __m512 f = _mm512_add_ps(_mm512_sub_ps(
+                            _mm512_add_ps(_mm512_mul_ps(A, x5),
+                                _mm512_mul_ps(B, x3)),
+                            _mm512_mul_ps(C, x)), D);
+
+                        f = _mm512_mask_blend_ps(
+                            _mm512_cmp_ps_mask(d, r, _CMP_GT_OQ), f, zero);
+                        f = _mm512_mask_blend_ps(
+                            _mm512_cmp_ps_mask(d, nr, _CMP_LT_OQ), f, one);
+                        _mm512_mask_storeu_ps(out + i, mask, f);
+                    }
+                }
+
+                BSOID_TARGET("avx512f")
+                void sphereSdfAvx512(PointSpan const& points,
+                    atlas::math::Point const& centre, float radius,
+                    float* out)
+                {
+                    const __m512 cx = _mm512_set1_ps(centre.x);
+                    const __m512 cy = _mm512_set1_ps(centre.y);
+                    const __m512 cz = _mm512_set1_ps(centre.z);
+                    const __m512 r = _mm512_set1_ps(radius);
+
+                    for (std::size_t i = 0; i < points.size; i += 16)
+                    {
+                        auto mask = tailMask(points.size - i);
+                        __m512 dx = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.x + i), cx);
+                        __m512 dy = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.y + i), cy);
+                        __m512 dz = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.z + i), cz);
+                        __m512 len = _mm512_add_ps(_mm512_add_ps(
+                            _mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy)),
+                            _mm512_mul_ps(dz, dz));
+                        __m512 root = _mm512_maskz_sqrt_ps(mask, len);
+                        _mm512_mask_storeu_ps(out + i, mask,
+                            _mm512_sub_ps(root, r));
+                    }
+                }
+
+                BSOID_TARGET("avx512f")
+                void torusSdfAvx512(PointSpan const& points,
+                    atlas::math::Point const& centre, float c, float a,
+                    float* out)
+                {
+                    const __m512 cx = _mm512_set1_ps(centre.x);
+                    const __m512 cy = _mm512_set1_ps(centre.y);
+                    const __m512 cz = _mm512_set1_ps(centre.z);
+                    const __m512 vc = _mm512_set1_ps(c);
+                    const __m512 a2 = _mm512_set1_ps(a * a);
+
+                    for (std::size_t i = 0; i < points.size; i += 16)
+                    {
+                        auto mask = tailMask(points.size - i);
+                        __m512 dx = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.x + i), cx);
+                        __m512 dy = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.y + i), cy);
+                        __m512 dz = _mm512_sub_ps(
+                            _mm512_maskz_loadu_ps(mask, points.z + i), cz);
+                        __m512 root = _mm512_maskz_sqrt_ps(mask,
+                            _mm512_add_ps(_mm512_mul_ps(dx, dx),
+                                _mm512_mul_ps(dy, dy)));
+                        __m512 l = _mm512_sub_ps(vc, root);
+                        __m512 sum = _mm512_add_ps(_mm512_mul_ps(l, l),
+                            _mm512_mul_ps(dz, dz));
+                        _mm512_mask_storeu_ps(out + i, mask,
+                            _mm512_sub_ps(sum, a2));
+                    }
+                }
+
+                BSOID_TARGET("avx512f")
+                void transformPointsAvx512(PointSpan const& points,
+                    atlas::math::Matrix4 const& m, float* x, float* y,
+                    float* z)
+                {
+                    float* outs[] = { x, y, z };
+                    for (std::size_t i = 0; i < points.size; i += 16)
+                    {
+                        auto mask = tailMask(points.size - i);
+                        __m512 px = _mm512_maskz_loadu_ps(mask, points.x + i);
+                        __m512 py = _mm512_maskz_loadu_ps(mask, points.y + i);
+                        __m512 pz = _mm512_maskz_loadu_ps(mask, points.z + i);
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            __m512 lo = _mm512_add_ps(
+                                _mm512_mul_ps(_mm512_set1_ps(m[0][k]), px),
+                                _mm512_mul_ps(_mm512_set1_ps(m[1][k]), py));
+                            __m512 hi = _mm512_add_ps(
+                                _mm512_mul_ps(_mm512_set1_ps(m[2][k]), pz),
+                                _mm512_set1_ps(m[3][k]));
+                            _mm512_mask_storeu_ps(outs[k] + i, mask,
+                                _mm512_add_ps(lo, hi));
+                        }
+                    }
+                }
+#endif
+            }
+
+            char const* getIsaName()
+            {
+                switch (getIsa())
+                {
+                case Isa::Avx512:
+                    return "AVX-512";
+                case Isa::Avx2:
+                    return "AVX2";
+                default:
+                    return "scalar";
+                }
+            }
+
+            void compactField(float const* dist, float* out, std::size_t n)
+            {
+#if BSOID_KERNELS_X86
+                switch (getIsa())
+                {
+                case Isa::Avx512:
+                    compactFieldAvx512(dist, out, n);
+                    return;
+                case Isa::Avx2:
+                    compactFieldAvx2(dist, out, n);
+                    return;
+                default:
+                    break;
+                }
+#endif
+                compactFieldScalar(dist, out, n);
+            }
+
+            void sphereSdf(PointSpan const& points,
+                atlas::math::Point const& centre, float radius, float* out)
+            {
+#if BSOID_KERNELS_X86
+                switch (getIsa())
+                {
+                case Isa::Avx512:
+                    sphereSdfAvx512(points, centre, radius, out);
+                    return;
+                case Isa::Avx2:
+                    sphereSdfAvx2(points, centre, radius, out);
+                    return;
+                default:
+                    break;
+                }
+#endif
+                sphereSdfScalar(points, centre, radius, out, 0);
+            }
+
+            void torusSdf(PointSpan const& points,
+                atlas::math::Point const& centre, float c, float a,
+                float* out)
+            {
+#if BSOID_KERNELS_X86
+                switch (getIsa())
+                {
+                case Isa::Avx512:
+                    torusSdfAvx512(points, centre, c, a, out);
+                    return;
+                case Isa::Avx2:
+                    torusSdfAvx2(points, centre, c, a, out);
+                    return;
+                default:
+                    break;
+                }
+#endif
+                torusSdfScalar(points, centre, c, a, out, 0);
+            }
+
+            void transformPoints(PointSpan const& points,
+                atlas::math::Matrix4 const& m, float* x, float* y, float* z)
+            {
+#if BSOID_KERNELS_X86
+                switch (getIsa())
+                {
+                case Isa::Avx512:
+                    transformPointsAvx512(points, m, x, y, z);
+                    return;
+                case Isa::Avx2:
+                    transformPointsAvx2(points, m, x, y, z);
+                    return;
+                default:
+                    break;
+                }
+#endif
+                transformPointsScalar(points, m, x, y, z, 0);
+            }
+        }
+    }
+}
@@ -0,0 +1,1291 @@
+#include "bsoid/fields/Program.hpp"
+#include "bsoid/fields/SkeletalField.hpp"
+#include "bsoid/fields/Filters.hpp"
+#include "bsoid/fields/Kernels.hpp"
+
+#include <atlas/core/Constants.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace bsoid
+{
+    namespace fields
+    {
+        namespace
+        {
+            // The stacks live on the stack as long as the program is shallow
+            // enough, which is almost always the case.
+            static constexpr std::size_t inlineDepth = 8;
+
+            template <typename T>
+            class Scratch
+            {
+            public:
+                Scratch(std::size_t size) :
+                    mData(mInline)
+                {
+                    if (size > inlineDepth)
+                    {
+                        mHeap.reset(new T[size]);
+                        mData = mHeap.get();
+                    }
+                }
+
+                T& operator[](std::size_t i)
+                {
+                    return mData[i];
+                }
+
+            private:
+                T mInline[inlineDepth];
+                std::unique_ptr<T[]> mHeap;
+                T* mData;
+            };
+
+            struct ValueSlot
+            {
+                float value[batchSize];
+            };
+
+            struct GradSlot
+            {
+                float value[batchSize];
+                float x[batchSize];
+                float y[batchSize];
+                float z[batchSize];
+            };
+
+            struct PointSlot
+            {
+                float x[batchSize];
+                float y[batchSize];
+                float z[batchSize];
+            };
+
+            // These follow the order of operations of Sphere and Torus
+            // exactly, so that the results are identical.
+            float sphereEval(atlas::math::Point const& p,
+                atlas::math::Point const& centre, float radius)
+            {
+                return compactField(glm::length(p - centre) - radius);
+            }
+
+            FieldValue sphereEvalGrad(atlas::math::Point const& p,
+                atlas::math::Point const& centre, float radius)
+            {
+                auto d = p - centre;
+                atlas::math::Normal g = 2.0f * d;
+
+                float value, gradient;
+                compactFieldGradient(glm::length(d) - radius, value, gradient);
+                return { value, gradient * g };
+            }
+
+            float torusEval(atlas::math::Point const& p,
+                atlas::math::Point const& centre, float c, float a)
+            {
+                using atlas::math::Point2;
+
+                float root = glm::length(
+                    Point2(p.x - centre.x, p.y - centre.y));
+                float z2 = (p.z - centre.z) * (p.z - centre.z);
+                float left = (c - root) * (c - root);
+                return compactField(left + z2 - (a * a));
+            }
+
+            FieldValue torusEvalGrad(atlas::math::Point const& p,
+                atlas::math::Point const& centre, float c, float a)
+            {
+                using atlas::math::Point2;
+
+                auto d = p - centre;
+                float root = glm::length(Point2(d.x, d.y));
+                atlas::math::Normal g;
+                g.x = -2.0f * (c - root) * d.x / root;
+                g.y = -2.0f * (c - root) * d.y / root;
+                g.z = 2.0f * d.z;
+
+                float value, gradient;
+                compactFieldGradient((c - root) * (c - root) + d.z * d.z -
+                    (a * a), value, gradient);
+                return { value, gradient * g };
+            }
+
+            atlas::math::Point transformPoint(atlas::math::Matrix4 const& m,
+                atlas::math::Point const& p)
+            {
+                return atlas::math::Point(m * atlas::math::Point4(p, 1.0f));
+            }
+
+            float fold(Program::OpCode op, float a, float b)
+            {
+                switch (op)
+                {
+                case Program::OpCode::Max:
+                    return glm::max(a, b);
+
+                case Program::OpCode::Min:
+                    return glm::min(a, b);
+
+                default:
+                    return a + b;
+                }
+            }
+
+            // Max and Min take the gradient of the child whose value they
+            // take, rather than the largest or smallest of each component,
+            // which can come from different children.
+            FieldValue foldGrad(Program::OpCode op, FieldValue const& a,
+                FieldValue const& b)
+            {
+                switch (op)
+                {
+                case Program::OpCode::Max:
+                    return (b.value > a.value) ? b : a;
+
+                case Program::OpCode::Min:
+                    return (b.value < a.value) ? b : a;
+
+                default:
+                    return { a.value + b.value, a.g + b.g };
+                }
+            }
+
+            // Boxes of fields that are empty, or were transformed from empty
+            // ones, do not bound anything.
+            atlas::utils::BBox boundPoints(PointSpan const& points)
+            {
+                atlas::utils::BBox box;
+                for (std::size_t k = 0; k < points.size; ++k)
+                {
+                    box = atlas::utils::join(box, atlas::math::Point(
+                        points.x[k], points.y[k], points.z[k]));
+                }
+
+                return box;
+            }
+
+            bool isBounded(atlas::utils::BBox const& box)
+            {
+                for (int i = 0; i < 3; ++i)
+                {
+                    if (!(box.pMin[i] <= box.pMax[i]) ||
+                        !std::isfinite(box.pMin[i]) ||
+                        !std::isfinite(box.pMax[i]))
+                    {
+                        return false;
+                    }
+                }
+
+                return true;
+            }
+        }
+
+        std::uint32_t const* Program::Gather::find(
+            atlas::math::Point const& p, std::size_t& count) const
+        {
+            std::size_t cell = cellStarts.size() - 2;
+            bool inside = dims[0] > 0;
+            for (int i = 0; i < 3; ++i)
+            {
+                inside = inside && origin[i] <= p[i] && p[i] <= limit[i];
+            }
+
+            if (inside)
+            {
+                int index[3];
+                for (int i = 0; i < 3; ++i)
+                {
+                    index[i] = std::min(dims[i] - 1, static_cast<int>(
+                        std::floor((p[i] - origin[i]) / cellSize[i])));
+                }
+
+                cell = (static_cast<std::size_t>(index[2]) * dims[1] +
+                    index[1]) * dims[0] + index[0];
+            }
+
+            count = cellStarts[cell + 1] - cellStarts[cell];
+            return cellChildren.data() + cellStarts[cell];
+        }
+
+        std::size_t Program::Gather::collect(atlas::utils::BBox const& box,
+            std::uint32_t* children) const
+        {
+            std::size_t count = 0;
+            for (std::size_t c = 0; c < starts.size(); ++c)
+            {
+                if (!bounded[c] || boxes[c].overlaps(box))
+                {
+                    children[count++] = static_cast<std::uint32_t>(c);
+                }
+            }
+
+            return count;
+        }
+
+        bool Program::Gather::saturated(float value) const
+        {
+            switch (combine)
+            {
+            case OpCode::Max:
+                return value >= hi;
+
+            case OpCode::Min:
+                return value <= lo;
+
+            default:
+                return false;
+            }
+        }
+
+        Program::Program() :
+            mDepth(0),
+            mMaxDepth(0),
+            mMaxTransformDepth(0),
+            mMaxGatherDepth(0),
+            mMaxChildren(0)
+        { }
+
+        void Program::compile(ImplicitField const& root)
+        {
+            clear();
+            root.compile(*this);
+            assert(mDepth == 1 && mOpenTransforms.empty() &&
+                mOpenGathers.empty());
+        }
+
+        void Program::clear()
+        {
+            mCode.clear();
+            mSpheres = Spheres();
+            mTori = Tori();
+            mFields.clear();
+            mInverse.clear();
+            mInverseT.clear();
+            mGathers.clear();
+            mOpenTransforms.clear();
+            mOpenGathers.clear();
+            mDepth = 0;
+            mMaxDepth = 0;
+            mMaxTransformDepth = 0;
+            mMaxGatherDepth = 0;
+            mMaxChildren = 0;
+        }
+
+        void Program::addSphere(SkeletalField const* field,
+            atlas::math::Point const& centre, float radius)
+        {
+            emit(OpCode::Sphere, mSpheres.radius.size(), 1);
+            mSpheres.x.push_back(centre.x);
+            mSpheres.y.push_back(centre.y);
+            mSpheres.z.push_back(centre.z);
+            mSpheres.radius.push_back(radius);
+            mSpheres.field.push_back(field);
+        }
+
+        void Program::addTorus(SkeletalField const* field,
+            atlas::math::Point const& centre, float c, float a)
+        {
+            emit(OpCode::Torus, mTori.c.size(), 1);
+            mTori.x.push_back(centre.x);
+            mTori.y.push_back(centre.y);
+            mTori.z.push_back(centre.z);
+            mTori.c.push_back(c);
+            mTori.a.push_back(a);
+            mTori.field.push_back(field);
+        }
+
+        void Program::addField(ImplicitField const* field)
+        {
+            // The field counts its own evaluations.
+            emit(OpCode::Field, mFields.size(), 1);
+            mFields.push_back(field);
+        }
+
+        void Program::addOp(OpCode op)
+        {
+            switch (op)
+            {
+            case OpCode::PushZero:
+            case OpCode::PushLowest:
+            case OpCode::PushHighest:
+                emit(op, 0, 1);
+                break;
+
+            case OpCode::Add:
+            case OpCode::Max:
+            case OpCode::Min:
+                assert(mDepth >= 2);
+                emit(op, 0, -1);
+                break;
+
+            default:
+                // Leaves and transforms have their own functions.
+                assert(false);
+                break;
+            }
+        }
+
+        void Program::pushTransform(atlas::math::Matrix4 const& inverse,
+            atlas::math::Matrix4 const& inverseT)
+        {
+            mOpenTransforms.push_back(
+                static_cast<std::uint32_t>(mInverse.size()));
+            mMaxTransformDepth =
+                std::max(mMaxTransformDepth, mOpenTransforms.size());
+
+            emit(OpCode::PushTransform, mInverse.size(), 0);
+            mInverse.push_back(inverse);
+            mInverseT.push_back(inverseT);
+        }
+
+        void Program::popTransform()
+        {
+            assert(!mOpenTransforms.empty());
+            emit(OpCode::PopTransform, mOpenTransforms.back(), 0);
+            mOpenTransforms.pop_back();
+        }
+
+        void Program::beginChildren(OpCode combine, std::size_t count)
+        {
+            assert(mDepth >= 1);
+            assert(combine == OpCode::Add || combine == OpCode::Max ||
+                combine == OpCode::Min);
+
+            bool gather = count >= gatherMinChildren;
+            mOpenGathers.push_back({ combine, gather,
+                static_cast<std::uint32_t>(mGathers.size()) });
+            if (!gather)
+            {
+                return;
+            }
+
+            mMaxGatherDepth = std::max(mMaxGatherDepth, std::size_t(
+                std::count_if(mOpenGathers.begin(), mOpenGathers.end(),
+                    [](OpenGather const& g) { return g.gather; })));
+            emit(OpCode::Gather, mGathers.size(), 0);
+
+            // The children that are skipped count as zero, so that is
+            // always among the values.
+            Gather g;
+            g.combine = combine;
+            g.end = 0;
+            g.lo = 0.0f;
+            g.hi = 0.0f;
+            std::fill(g.dims, g.dims + 3, 0);
+            mGathers.push_back(std::move(g));
+        }
+
+        void Program::beginChild(ImplicitField const& child)
+        {
+            assert(!mOpenGathers.empty());
+            if (!mOpenGathers.back().gather)
+            {
+                return;
+            }
+
+            auto& gather = mGathers[mOpenGathers.back().index];
+            auto box = child.getBBox();
+            auto range = child.evalInterval(box);
+            gather.lo = std::min(gather.lo, range.lo);
+            gather.hi = std::max(gather.hi, range.hi);
+            gather.starts.push_back(static_cast<std::uint32_t>(mCode.size()));
+            gather.boxes.push_back(box);
+        }
+
+        void Program::endChild()
+        {
+            assert(!mOpenGathers.empty());
+            addOp(mOpenGathers.back().combine);
+            if (mOpenGathers.back().gather)
+            {
+                emit(OpCode::Next, 0, 0);
+            }
+        }
+
+        void Program::endChildren()
+        {
+            assert(!mOpenGathers.empty());
+            if (mOpenGathers.back().gather)
+            {
+                auto& gather = mGathers[mOpenGathers.back().index];
+                gather.end = static_cast<std::uint32_t>(mCode.size());
+                buildGrid(gather);
+                mMaxChildren = std::max(mMaxChildren, gather.starts.size());
+            }
+
+            mOpenGathers.pop_back();
+        }
+
+        float Program::eval(atlas::math::Point const& p) const
+        {
+            if (mCode.empty())
+            {
+                return 0.0f;
+            }
+
+            Scratch<float> stack(mMaxDepth);
+            Scratch<atlas::math::Point> points(mMaxTransformDepth);
+            Scratch<GatherState> gathers(mMaxGatherDepth);
+            std::size_t top = 0, pointTop = 0, gatherTop = 0;
+            atlas::math::Point point = p;
+
+            for (std::size_t pc = 0; pc < mCode.size(); )
+            {
+                auto& ins = mCode[pc++];
+                auto i = ins.arg;
+                switch (ins.op)
+                {
+                case OpCode::Sphere:
+                    mSpheres.field[i]->countEvaluations(1);
+                    stack[top++] = sphereEval(point,
+                        { mSpheres.x[i], mSpheres.y[i], mSpheres.z[i] },
+                        mSpheres.radius[i]);
+                    break;
+
+                case OpCode::Torus:
+                    mTori.field[i]->countEvaluations(1);
+                    stack[top++] = torusEval(point,
+                        { mTori.x[i], mTori.y[i], mTori.z[i] },
+                        mTori.c[i], mTori.a[i]);
+                    break;
+
+                case OpCode::Field:
+                    stack[top++] = mFields[i]->eval(point);
+                    break;
+
+                case OpCode::PushZero:
+                    stack[top++] = 0.0f;
+                    break;
+
+                case OpCode::PushLowest:
+                    stack[top++] = -std::numeric_limits<float>::infinity();
+                    break;
+
+                case OpCode::PushHighest:
+                    stack[top++] = atlas::core::infinity();
+                    break;
+
+                case OpCode::Add:
+                    --top;
+                    stack[top - 1] += stack[top];
+                    break;
+
+                case OpCode::Max:
+                    --top;
+                    stack[top - 1] = glm::max(stack[top - 1], stack[top]);
+                    break;
+
+                case OpCode::Min:
+                    --top;
+                    stack[top - 1] = glm::min(stack[top - 1], stack[top]);
+                    break;
+
+                case OpCode::PushTransform:
+                    points[pointTop++] = point;
+                    point = transformPoint(mInverse[i], point);
+                    break;
+
+                case OpCode::PopTransform:
+                    point = points[--pointTop];
+                    break;
+
+                case OpCode::Gather:
+                {
+                    auto& gather = mGathers[i];
+                    std::size_t count;
+                    auto children = gather.find(point, count);
+                    if (count == 0)
+                    {
+                        if (!gather.starts.empty())
+                        {
+                            stack[top - 1] =
+                                fold(gather.combine, stack[top - 1], 0.0f);
+                        }
+                        pc = gather.end;
+                        break;
+                    }
+
+                    gathers[gatherTop++] = { &gather, children, count, 0 };
+                    pc = gather.starts[children[0]];
+                    break;
+                }
+
+                case OpCode::Next:
+                {
+                    auto& state = gathers[gatherTop - 1];
+                    auto& gather = *state.gather;
+                    if (++state.next < state.count &&
+                        !gather.saturated(stack[top - 1]))
+                    {
+                        pc = gather.starts[state.children[state.next]];
+                        break;
+                    }
+
+                    if (state.count < gather.starts.size())
+                    {
+                        stack[top - 1] =
+                            fold(gather.combine, stack[top - 1], 0.0f);
+                    }
+                    pc = gather.end;
+                    --gatherTop;
+                    break;
+                }
+                }
+            }
+
+            return stack[0];
+        }
+
+        atlas::math::Normal Program::grad(atlas::math::Point const& p) const
+        {
+            return trace(p, true).g;
+        }
+
+        FieldValue Program::evalGrad(atlas::math::Point const& p) const
+        {
+            return trace(p, false);
+        }
+
+        void Program::evalBatch(PointSpan const& points, float* values) const
+        {
+            if (mCode.empty())
+            {
+                std::fill(values, values + points.size, 0.0f);
+                return;
+            }
+
+            Scratch<ValueSlot> stack(mMaxDepth);
+            Scratch<PointSlot> transformed(mMaxTransformDepth);
+            Scratch<PointSpan> saved(mMaxTransformDepth);
+            Scratch<GatherState> gathers(mMaxGatherDepth);
+            std::vector<std::uint32_t> lists(mMaxGatherDepth * mMaxChildren);
+
+            // The bounds of the chunk in the space of every transform, which
+            // the children are culled against.
+            Scratch<atlas::utils::BBox> bounds(mMaxTransformDepth + 1);
+            bool cull = !mGathers.empty();
+
+            auto foldZero = [](OpCode op, ValueSlot& slot, std::size_t n)
+            {
+                for (std::size_t k = 0; k < n; ++k)
+                {
+                    slot.value[k] = fold(op, slot.value[k], 0.0f);
+                }
+            };
+
+            for (std::size_t offset = 0; offset < points.size;
+                offset += batchSize)
+            {
+                auto n = std::min(batchSize, points.size - offset);
+                auto chunk = points.subspan(offset, n);
+                std::size_t top = 0, pointTop = 0, gatherTop = 0;
+                if (cull)
+                {
+                    bounds[0] = boundPoints(chunk);
+                }
+
+                for (std::size_t pc = 0; pc < mCode.size(); )
+                {
+                    auto& ins = mCode[pc++];
+                    auto i = ins.arg;
+                    switch (ins.op)
+                    {
+                    case OpCode::Sphere:
+                    {
+                        mSpheres.field[i]->countEvaluations(n);
+                        auto out = stack[top++].value;
+                        kernels::sphereSdf(chunk,
+                            { mSpheres.x[i], mSpheres.y[i], mSpheres.z[i] },
+                            mSpheres.radius[i], out);
+                        kernels::compactField(out, out, n);
+                        break;
+                    }
+
+                    case OpCode::Torus:
+                    {
+                        mTori.field[i]->countEvaluations(n);
+                        auto out = stack[top++].value;
+                        kernels::torusSdf(chunk,
+                            { mTori.x[i], mTori.y[i], mTori.z[i] },
+                            mTori.c[i], mTori.a[i], out);
+                        kernels::compactField(out, out, n);
+                        break;
+                    }
+
+                    case OpCode::Field:
+                        mFields[i]->evalBatch(chunk, stack[top++].value);
+                        break;
+
+                    case OpCode::PushZero:
+                    {
+                        auto out = stack[top++].value;
+                        std::fill(out, out + n, 0.0f);
+                        break;
+                    }
+
+                    case OpCode::PushLowest:
+                    {
+                        auto out = stack[top++].value;
+                        std::fill(out, out + n,
+                            -std::numeric_limits<float>::infinity());
+                        break;
+                    }
+
+                    case OpCode::PushHighest:
+                    {
+                        auto out = stack[top++].value;
+                        std::fill(out, out + n, atlas::core::infinity());
+                        break;
+                    }
+
+                    case OpCode::Add:
+                    {
+                        --top;
+                        auto out = stack[top - 1].value;
+                        auto in = stack[top].value;
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            out[k] += in[k];
+                        }
+                        break;
+                    }
+
+                    case OpCode::Max:
+                    {
+                        --top;
+                        auto out = stack[top - 1].value;
+                        auto in = stack[top].value;
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            out[k] = glm::max(out[k], in[k]);
+                        }
+                        break;
+                    }
+
+                    case OpCode::Min:
+                    {
+                        --top;
+                        auto out = stack[top - 1].value;
+                        auto in = stack[top].value;
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            out[k] = glm::min(out[k], in[k]);
+                        }
+                        break;
+                    }
+
+                    case OpCode::PushTransform:
+                    {
+                        auto& q = transformed[pointTop];
+                        saved[pointTop++] = chunk;
+                        kernels::transformPoints(chunk, mInverse[i],
+                            q.x, q.y, q.z);
+                        chunk = { q.x, q.y, q.z, n };
+                        if (cull)
+                        {
+                            bounds[pointTop] = boundPoints(chunk);
+                        }
+                        break;
+                    }
+
+                    case OpCode::PopTransform:
+                        chunk = saved[--pointTop];
+                        break;
+
+                    case OpCode::Gather:
+                    {
+                        auto& gather = mGathers[i];
+                        auto children = lists.data() + gatherTop * mMaxChildren;
+                        auto count = gather.collect(bounds[pointTop],
+                            children);
+                        if (count == 0)
+                        {
+                            if (!gather.starts.empty())
+                            {
+                                foldZero(gather.combine, stack[top - 1], n);
+                            }
+                            pc = gather.end;
+                            break;
+                        }
+
+                        gathers[gatherTop++] = { &gather, children, count, 0 };
+                        pc = gather.starts[children[0]];
+                        break;
+                    }
+
+                    case OpCode::Next:
+                    {
+                        auto& state = gathers[gatherTop - 1];
+                        auto& gather = *state.gather;
+                        auto out = stack[top - 1].value;
+                        if (++state.next < state.count &&
+                            !std::all_of(out, out + n, [&gather](float v)
+                                { return gather.saturated(v); }))
+                        {
+                            pc = gather.starts[state.children[state.next]];
+                            break;
+                        }
+
+                        if (state.count < gather.starts.size())
+                        {
+                            foldZero(gather.combine, stack[top - 1], n);
+                        }
+                        pc = gather.end;
+                        --gatherTop;
+                        break;
+                    }
+                    }
+                }
+
+                std::copy(stack[0].value, stack[0].value + n,
+                    values + offset);
+            }
+        }
+
+        void Program::evalGradBatch(PointSpan const& points, float* values,
+            NormalSpan const& gradients) const
+        {
+            if (mCode.empty())
+            {
+                std::fill(values, values + points.size, 0.0f);
+                std::fill(gradients.x, gradients.x + points.size, 0.0f);
+                std::fill(gradients.y, gradients.y + points.size, 0.0f);
+                std::fill(gradients.z, gradients.z + points.size, 0.0f);
+                return;
+            }
+
+            Scratch<GradSlot> stack(mMaxDepth);
+            Scratch<PointSlot> transformed(mMaxTransformDepth);
+            Scratch<PointSpan> saved(mMaxTransformDepth);
+            Scratch<GatherState> gathers(mMaxGatherDepth);
+            std::vector<std::uint32_t> lists(mMaxGatherDepth * mMaxChildren);
+
+            // The bounds of the chunk in the space of every transform, which
+            // the children are culled against.
+            Scratch<atlas::utils::BBox> bounds(mMaxTransformDepth + 1);
+            bool cull = !mGathers.empty();
+
+            auto fill = [](GradSlot& slot, std::size_t n, float v)
+            {
+                std::fill(slot.value, slot.value + n, v);
+                std::fill(slot.x, slot.x + n, v);
+                std::fill(slot.y, slot.y + n, v);
+                std::fill(slot.z, slot.z + n, v);
+            };
+
+            auto store = [](GradSlot& slot, std::size_t k, FieldValue const& v)
+            {
+                slot.value[k] = v.value;
+                slot.x[k] = v.g.x;
+                slot.y[k] = v.g.y;
+                slot.z[k] = v.g.z;
+            };
+
+            // The children that were skipped have a zero gradient as well.
+            auto foldZero = [](OpCode op, GradSlot& slot, std::size_t n)
+            {
+                const FieldValue zero = { 0.0f, atlas::math::Normal(0.0f) };
+                for (std::size_t k = 0; k < n; ++k)
+                {
+                    FieldValue v = { slot.value[k],
+                        { slot.x[k], slot.y[k], slot.z[k] } };
+                    v = foldGrad(op, v, zero);
+                    slot.value[k] = v.value;
+                    slot.x[k] = v.g.x;
+                    slot.y[k] = v.g.y;
+                    slot.z[k] = v.g.z;
+                }
+            };
+
+            for (std::size_t offset = 0; offset < points.size;
+                offset += batchSize)
+            {
+                auto n = std::min(batchSize, points.size - offset);
+                auto chunk = points.subspan(offset, n);
+                std::size_t top = 0, pointTop = 0, gatherTop = 0;
+                if (cull)
+                {
+                    bounds[0] = boundPoints(chunk);
+                }
+
+                for (std::size_t pc = 0; pc < mCode.size(); )
+                {
+                    auto& ins = mCode[pc++];
+                    auto i = ins.arg;
+                    switch (ins.op)
+                    {
+                    case OpCode::Sphere:
+                    {
+                        mSpheres.field[i]->countEvaluations(n);
+                        auto& out = stack[top++];
+                        atlas::math::Point centre(mSpheres.x[i],
+                            mSpheres.y[i], mSpheres.z[i]);
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            store(out, k, sphereEvalGrad(
+                                { chunk.x[k], chunk.y[k], chunk.z[k] },
+                                centre, mSpheres.radius[i]));
+                        }
+                        break;
+                    }
+
+                    case OpCode::Torus:
+                    {
+                        mTori.field[i]->countEvaluations(n);
+                        auto& out = stack[top++];
+                        atlas::math::Point centre(mTori.x[i], mTori.y[i],
+                            mTori.z[i]);
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            store(out, k, torusEvalGrad(
+                                { chunk.x[k], chunk.y[k], chunk.z[k] },
+                                centre, mTori.c[i], mTori.a[i]));
+                        }
+                        break;
+                    }
+
+                    case OpCode::Field:
+                    {
+                        auto& out = stack[top++];
+                        mFields[i]->evalGradBatch(chunk, out.value,
+                            { out.x, out.y, out.z });
+                        break;
+                    }
+
+                    case OpCode::PushZero:
+                        fill(stack[top++], n, 0.0f);
+                        break;
+
+                    case OpCode::PushLowest:
+                        fill(stack[top++], n,
+                            -std::numeric_limits<float>::infinity());
+                        break;
+
+                    case OpCode::PushHighest:
+                        fill(stack[top++], n, atlas::core::infinity());
+                        break;
+
+                    case OpCode::Add:
+                    {
+                        --top;
+                        auto& out = stack[top - 1];
+                        auto& in = stack[top];
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            out.value[k] += in.value[k];
+                            out.x[k] += in.x[k];
+                            out.y[k] += in.y[k];
+                            out.z[k] += in.z[k];
+                        }
+                        break;
+                    }
+
+                    case OpCode::Max:
+                    {
+                        --top;
+                        auto& out = stack[top - 1];
+                        auto& in = stack[top];
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            if (in.value[k] > out.value[k])
+                            {
+                                out.value[k] = in.value[k];
+                                out.x[k] = in.x[k];
+                                out.y[k] = in.y[k];
+                                out.z[k] = in.z[k];
+                            }
+                        }
+                        break;
+                    }
+
+                    case OpCode::Min:
+                    {
+                        --top;
+                        auto& out = stack[top - 1];
+                        auto& in = stack[top];
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            if (in.value[k] < out.value[k])
+                            {
+                                out.value[k] = in.value[k];
+                                out.x[k] = in.x[k];
+                                out.y[k] = in.y[k];
+                                out.z[k] = in.z[k];
+                            }
+                        }
+                        break;
+                    }
+
+                    case OpCode::PushTransform:
+                    {
+                        auto& q = transformed[pointTop];
+                        saved[pointTop++] = chunk;
+                        kernels::transformPoints(chunk, mInverse[i],
+                            q.x, q.y, q.z);
+                        chunk = { q.x, q.y, q.z, n };
+                        if (cull)
+                        {
+                            bounds[pointTop] = boundPoints(chunk);
+                        }
+                        break;
+                    }
+
+                    case OpCode::PopTransform:
+                    {
+                        chunk = saved[--pointTop];
+                        auto& out = stack[top - 1];
+                        for (std::size_t k = 0; k < n; ++k)
+                        {
+                            auto g = kernels::transformGradient(
+                                mInverseT[i],
+                                { out.x[k], out.y[k], out.z[k] });
+                            out.x[k] = g.x;
+                            out.y[k] = g.y;
+                            out.z[k] = g.z;
+                        }
+                        break;
+                    }
+
+                    case OpCode::Gather:
+                    {
+                        auto& gather = mGathers[i];
+                        auto children = lists.data() + gatherTop * mMaxChildren;
+                        auto count = gather.collect(bounds[pointTop],
+                            children);
+                        if (count == 0)
+                        {
+                            if (!gather.starts.empty())
+                            {
+                                foldZero(gather.combine, stack[top - 1], n);
+                            }
+                            pc = gather.end;
+                            break;
+                        }
+
+                        gathers[gatherTop++] = { &gather, children, count, 0 };
+                        pc = gather.starts[children[0]];
+                        break;
+                    }
+
+                    case OpCode::Next:
+                    {
+                        // The gradient comes from the child with the winning
+                        // value, and the children left once that saturates
+                        // cannot beat it, so this stops early just as in
+                        // evalBatch.
+                        auto& state = gathers[gatherTop - 1];
+                        auto& gather = *state.gather;
+                        auto out = stack[top - 1].value;
+                        if (++state.next < state.count &&
+                            !std::all_of(out, out + n, [&gather](float v)
+                                { return gather.saturated(v); }))
+                        {
+                            pc = gather.starts[state.children[state.next]];
+                            break;
+                        }
+
+                        if (state.count < gather.starts.size())
+                        {
+                            foldZero(gather.combine, stack[top - 1], n);
+                        }
+                        pc = gather.end;
+                        --gatherTop;
+                        break;
+                    }
+                    }
+                }
+
+                auto& result = stack[0];
+                std::copy(result.value, result.value + n, values + offset);
+                std::copy(result.x, result.x + n, gradients.x + offset);
+                std::copy(result.y, result.y + n, gradients.y + offset);
+                std::copy(result.z, result.z + n, gradients.z + offset);
+            }
+        }
+
+        bool Program::empty() const
+        {
+            return mCode.empty();
+        }
+
+        std::size_t Program::size() const
+        {
+            std::size_t gathers = mGathers.capacity() * sizeof(Gather);
+            for (auto& gather : mGathers)
+            {
+                gathers += (gather.starts.capacity() +
+                    gather.cellStarts.capacity() +
+                    gather.cellChildren.capacity()) * sizeof(std::uint32_t) +
+                    gather.boxes.capacity() * sizeof(atlas::utils::BBox) +
+                    gather.bounded.capacity() / 8;
+            }
+
+            return sizeof(Program) +
+                mCode.capacity() * sizeof(Instruction) +
+                (mSpheres.x.capacity() + mSpheres.y.capacity() +
+                 mSpheres.z.capacity() + mSpheres.radius.capacity() +
+                 mTori.x.capacity() + mTori.y.capacity() +
+                 mTori.z.capacity() + mTori.c.capacity() +
+                 mTori.a.capacity()) * sizeof(float) +
+                (mFields.capacity() + mSpheres.field.capacity() +
+                 mTori.field.capacity()) * sizeof(ImplicitField const*) +
+                (mInverse.capacity() + mInverseT.capacity()) *
+                sizeof(atlas::math::Matrix4) + gathers;
+        }
+
+        // Computes the value and gradient at p. This is used for grad as
+        // well, in which case nothing is counted, just as in
+        // ImplicitField::grad.
+        FieldValue Program::trace(atlas::math::Point const& p,
+            bool grad) const
+        {
+            if (mCode.empty())
+            {
+                return { 0.0f, atlas::math::Normal(0.0f) };
+            }
+
+            Scratch<FieldValue> stack(mMaxDepth);
+            Scratch<atlas::math::Point> points(mMaxTransformDepth);
+            Scratch<GatherState> gathers(mMaxGatherDepth);
+            std::size_t top = 0, pointTop = 0, gatherTop = 0;
+            atlas::math::Point point = p;
+            std::uint64_t counted = (grad) ? 0 : 1;
+
+            auto push = [&stack, &top](float v)
+            {
+                stack[top++] = { v, atlas::math::Normal(v) };
+            };
+
+            auto foldZero = [](OpCode op, FieldValue& v)
+            {
+                v = foldGrad(op, v, { 0.0f, atlas::math::Normal(0.0f) });
+            };
+
+            for (std::size_t pc = 0; pc < mCode.size(); )
+            {
+                auto& ins = mCode[pc++];
+                auto i = ins.arg;
+                switch (ins.op)
+                {
+                case OpCode::Sphere:
+                    mSpheres.field[i]->countEvaluations(counted);
+                    stack[top++] = sphereEvalGrad(point,
+                        { mSpheres.x[i], mSpheres.y[i], mSpheres.z[i] },
+                        mSpheres.radius[i]);
+                    break;
+
+                case OpCode::Torus:
+                    mTori.field[i]->countEvaluations(counted);
+                    stack[top++] = torusEvalGrad(point,
+                        { mTori.x[i], mTori.y[i], mTori.z[i] },
+                        mTori.c[i], mTori.a[i]);
+                    break;
+
+                case OpCode::Field:
+                    if (grad)
+                    {
+                        stack[top++] = mFields[i]->evalGradUncounted(point);
+                    }
+                    else
+                    {
+                        stack[top++] = mFields[i]->evalGrad(point);
+                    }
+                    break;
+
+                case OpCode::PushZero:
+                    push(0.0f);
+                    break;
+
+                case OpCode::PushLowest:
+                    push(-std::numeric_limits<float>::infinity());
+                    break;
+
+                case OpCode::PushHighest:
+                    push(atlas::core::infinity());
+                    break;
+
+                case OpCode::Add:
+                    --top;
+                    stack[top - 1].value += stack[top].value;
+                    stack[top - 1].g += stack[top].g;
+                    break;
+
+                case OpCode::Max:
+                case OpCode::Min:
+                    --top;
+                    stack[top - 1] = foldGrad(ins.op, stack[top - 1],
+                        stack[top]);
+                    break;
+
+                case OpCode::PushTransform:
+                    points[pointTop++] = point;
+                    point = transformPoint(mInverse[i], point);
+                    break;
+
+                case OpCode::PopTransform:
+                    point = points[--pointTop];
+                    stack[top - 1].g = kernels::transformGradient(
+                        mInverseT[i], stack[top - 1].g);
+                    break;
+
+                case OpCode::Gather:
+                {
+                    auto& gather = mGathers[i];
+                    std::size_t count;
+                    auto children = gather.find(point, count);
+                    if (count == 0)
+                    {
+                        if (!gather.starts.empty())
+                        {
+                            foldZero(gather.combine, stack[top - 1]);
+                        }
+                        pc = gather.end;
+                        break;
+                    }
+
+                    gathers[gatherTop++] = { &gather, children, count, 0 };
+                    pc = gather.starts[children[0]];
+                    break;
+                }
+
+                case OpCode::Next:
+                {
+                    // As in evalGradBatch, this stops early once the value
+                    // saturates.
+                    auto& state = gathers[gatherTop - 1];
+                    auto& gather = *state.gather;
+                    if (++state.next < state.count &&
+                        !gather.saturated(stack[top - 1].value))
+                    {
+                        pc = gather.starts[state.children[state.next]];
+                        break;
+                    }
+
+                    if (state.count < gather.starts.size())
+                    {
+                        foldZero(gather.combine, stack[top - 1]);
+                    }
+                    pc = gather.end;
+                    --gatherTop;
+                    break;
+                }
+                }
+            }
+
+            return stack[0];
+        }
+
+        void Program::emit(OpCode op, std::size_t arg, int push)
+        {
+            mCode.push_back({ op, static_cast<std::uint32_t>(arg) });
+            mDepth += push;
+            mMaxDepth = std::max(mMaxDepth, mDepth);
+        }
+
+        // Sorts the children into the cells their bounds overlap, in two
+        // passes: the first counts the children of every cell and the
+        // second fills them in.
+        void Program::buildGrid(Gather& gather)
+        {
+            auto count = gather.starts.size();
+            gather.bounded.resize(count);
+
+            atlas::utils::BBox bounds;
+            bool any = false;
+            for (std::size_t c = 0; c < count; ++c)
+            {
+                gather.bounded[c] = isBounded(gather.boxes[c]);
+                if (gather.bounded[c])
+                {
+                    bounds = atlas::utils::join(bounds, gather.boxes[c]);
+                    any = true;
+                }
+            }
+
+            // Aim for a handful of children in every cell.
+            int resolution = (any) ? static_cast<int>(std::min(16.0,
+                2.0 * std::ceil(std::cbrt(static_cast<double>(count))))) : 0;
+            gather.origin = bounds.pMin;
+            gather.limit = bounds.pMax;
+            for (int i = 0; i < 3; ++i)
+            {
+                float extent = bounds.pMax[i] - bounds.pMin[i];
+                gather.dims[i] = (any && extent > 0.0f) ? resolution :
+                    ((any) ? 1 : 0);
+                gather.cellSize[i] = (gather.dims[i] > 1) ?
+                    extent / gather.dims[i] : 1.0f;
+            }
+
+            auto cellOf = [&gather](float x, int i)
+            {
+                int index = static_cast<int>(
+                    std::floor((x - gather.origin[i]) / gather.cellSize[i]));
+                return std::max(0, std::min(gather.dims[i] - 1, index));
+            };
+
+            std::size_t cells = static_cast<std::size_t>(gather.dims[0]) *
+                gather.dims[1] * gather.dims[2];
+            gather.cellStarts.assign(cells + 2, 0);
+
+            auto visit = [&](auto&& add)
+            {
+                for (std::size_t c = 0; c < count; ++c)
+                {
+                    if (!gather.bounded[c])
+                    {
+                        for (std::size_t cell = 0; cell <= cells; ++cell)
+                        {
+                            add(cell, c);
+                        }
+                        continue;
+                    }
+
+                    auto& box = gather.boxes[c];
+                    int lo[3], hi[3];
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        lo[i] = cellOf(box.pMin[i], i);
+                        hi[i] = cellOf(box.pMax[i], i);
+                    }
+
+                    for (int z = lo[2]; z <= hi[2]; ++z)
+                    {
+                        for (int y = lo[1]; y <= hi[1]; ++y)
+                        {
+                            for (int x = lo[0]; x <= hi[0]; ++x)
+                            {
+                                add((static_cast<std::size_t>(z) *
+                                    gather.dims[1] + y) * gather.dims[0] + x,
+                                    c);
+                            }
+                        }
+                    }
+                }
+            };
+
+            visit([&gather](std::size_t cell, std::size_t)
+            {
+                ++gather.cellStarts[cell + 1];
+            });
+
+            for (std::size_t cell = 0; cell <= cells; ++cell)
+            {
+                gather.cellStarts[cell + 1] += gather.cellStarts[cell];
+            }
+
+            gather.cellChildren.resize(gather.cellStarts.back());
+            std::vector<std::uint32_t> next(gather.cellStarts.begin(),
+                gather.cellStarts.end() - 1);
+            visit([&gather, &next](std::size_t cell, std::size_t c)
+            {
+                gather.cellChildren[next[cell]++] =
+                    static_cast<std::uint32_t>(c);
+            });
+        }
+    }
+}
@@ -2,6 +2,7 @@
 
 #include "bsoid/fields/Sphere.hpp"
 #include "bsoid/fields/Torus.hpp"
+#include "bsoid/fields/StaticField.hpp"
 
 #include "bsoid/operators/Blend.hpp"
 #include "bsoid/operators/Intersection.hpp"
@@ -28,6 +29,75 @@ namespace bsoid
         using polygonizer::Bsoid;
         using polygonizer::MarchingCubes;
 
+        namespace
+        {
+            // The static models are a single field as far as the tree is
+            // concerned.
+            BlobTree makeStaticTree(ImplicitFieldPtr const& field)
+            {
+                BlobTree tree;
+                tree.insertField(field);
+                tree.insertNodeTree({ { -1 } });
+                tree.insertFieldTree(field);
+                tree.insertSkeletalField(field);
+                return tree;
+            }
+
+            auto butterflyExpr()
+            {
+                using atlas::math::Matrix4;
+                using atlas::math::Vector;
+                using namespace fields::expr;
+
+                auto body = unite(
+                    transform(glm::translate(Matrix4(1.0f),
+                        Vector(-1.0f, 0.0f, 0.0f)), sphere()),
+                    transform(glm::translate(Matrix4(1.0f),
+                        Vector(1.0f, 0.0f, 0.0f)) *
+                        glm::scale(Matrix4(1.0f), Vector(2.0f, 1.0f, 1.0f)),
+                        sphere()),
+                    transform(glm::translate(Matrix4(1.0f),
+                        Vector(3.0f, 0.0f, 0.0f)) *
+                        glm::scale(Matrix4(1.0f), Vector(4.0f, 1.0f, 1.0f)),
+                        sphere()));
+
+                auto wingR = blend(
+                    transform(
+                        glm::translate(Matrix4(1.0f), Vector(0.0f, 0.0f, 3.0f)) *
+                        glm::rotate(Matrix4(1.0f), glm::radians(90.0f),
+                            Vector(1, 0, 0)) *
+                        glm::rotate(Matrix4(1.0f), glm::radians(45.0f),
+                            Vector(0, 0, -1)) *
+                        glm::scale(Matrix4(1.0f), Vector(0.5f)) *
+                        glm::scale(Matrix4(1.0f), Vector(2.5f, 1.0f, 1.0f)),
+                        torus()),
+                    transform(
+                        glm::translate(Matrix4(1.0f), Vector(3.0f, 0.0f, 2.5f)) *
+                        glm::rotate(Matrix4(1.0f), glm::radians(-90.0f),
+                            Vector(1, 0, 0)) *
+                        glm::rotate(Matrix4(1.0f), glm::radians(-90.0f),
+                            Vector(0, 0, -1)) *
+                        glm::scale(Matrix4(1.0f), Vector(0.5f)) *
+                        glm::scale(Matrix4(1.0f), Vector(2.0f, 1.0f, 1.0f)),
+                        torus()));
+
+                auto wingL = transform(glm::rotate(Matrix4(1.0f),
+                    glm::radians(180.0f), Vector(1, 0, 0)), wingR);
+
+                return fields::makeStaticField(unite(body, wingR, wingL));
+            }
+
+            template <std::size_t... I>
+            auto chainExpr(std::index_sequence<I...>)
+            {
+                using atlas::math::Point;
+                using namespace fields::expr;
+
+                return fields::makeStaticField(blend(
+                    sphere(1.0f, Point(-10.0f + 2.0f * I, 0, 0))...));
+            }
+        }
+
         polygonizer::Bsoid makeSphere(Resolution const& res)
         {
             using fields::Sphere;
@@ -617,5 +687,60 @@ namespace bsoid
             mc.setResolution(std::get<0>(res));
             return mc;
         }
+
+        polygonizer::Bsoid makeStaticTorus(Resolution const& res)
+        {
+            auto torus = fields::makeStaticField(fields::expr::torus());
+
+            Bsoid soid(makeStaticTree(torus), "static torus");
+            soid.setResolution(std::get<0>(res),
+                std::get<1>(res));
+            return soid;
+        }
+
+        polygonizer::MarchingCubes makeMCStaticTorus(Resolution const& res)
+        {
+            auto torus = fields::makeStaticField(fields::expr::torus());
+
+            MarchingCubes mc(makeStaticTree(torus), "static torus");
+            mc.setResolution(std::get<0>(res));
+            return mc;
+        }
+
+        polygonizer::Bsoid makeStaticButterfly(Resolution const& res)
+        {
+            Bsoid soid(makeStaticTree(butterflyExpr()), "static butterfly");
+            soid.setResolution(std::get<0>(res),
+                std::get<1>(res));
+            return soid;
+        }
+
+        polygonizer::MarchingCubes makeMCStaticButterfly(
+            Resolution const& res)
+        {
+            MarchingCubes mc(makeStaticTree(butterflyExpr()),
+                "static butterfly");
+            mc.setResolution(std::get<0>(res));
+            return mc;
+        }
+
+        polygonizer::Bsoid makeStaticChain(Resolution const& res)
+        {
+            auto chain = chainExpr(std::make_index_sequence<20>());
+
+            Bsoid soid(makeStaticTree(chain), "static chain");
+            soid.setResolution(std::get<0>(res),
+                std::get<1>(res));
+            return soid;
+        }
+
+        polygonizer::MarchingCubes makeMCStaticChain(Resolution const& res)
+        {
+            auto chain = chainExpr(std::make_index_sequence<20>());
+
+            MarchingCubes mc(makeStaticTree(chain), "static chain");
+            mc.setResolution(std::get<0>(res));
+            return mc;
+        }
     }
 }
@@ -12,28 +12,75 @@
 #include <functional>
 #include <unordered_set>
 #include <fstream>
-#include <queue>
+#include <deque>
+#include <cmath>
 
 #include <tbb/parallel_for.h>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/concurrent_vector.h>
 #include <glm/gtx/component_wise.hpp>
 
 #define DISABLE_PARALLEL 0
 
+namespace
+{
+    // Octree cells that are reached by at most this many primitives are
+    // not split any further.
+    constexpr std::size_t maxSuperVoxelLeaves = 8;
+
+    // Number of triangles each thread gathers before handing them to the
+    // triangle callback.
+    constexpr std::size_t triangleBatchSize = 256;
+
+    // Limits for the Newton search that takes seeds to the surface. A
+    // single step never covers more than this many cells.
+    constexpr int maxSeedIterations = 32;
+    constexpr float maxSeedStep = 8.0f;
+}
+
 
 namespace bsoid
 {
     namespace polygonizer
     {
         Bsoid::Bsoid() :
+            mLazyGradients(true),
+            mStreaming(true),
+            mCompact(false),
+            mPeakEdges(0),
+            mSeedsUsed(0),
+            mSeedsDuplicate(0),
+            mSeedsVisited(0),
+            mSeedsMissed(0),
+            mSeedsGenerated(0),
+            mGeneratedMissed(0),
+            mFindUnseeded(false),
+            mUnseededTime(0.0f),
+            mBatchSink(nullptr),
             mName("model")
         { }
 
         Bsoid::Bsoid(tree::BlobTree const& model, std::string const& name,
             float isoValue) :
             mMagic(isoValue),
+            mLazyGradients(true),
+            mStreaming(true),
+            mCompact(false),
+            mPeakEdges(0),
+            mSeedsUsed(0),
+            mSeedsDuplicate(0),
+            mSeedsVisited(0),
+            mSeedsMissed(0),
+            mSeedsGenerated(0),
+            mGeneratedMissed(0),
+            mFindUnseeded(false),
+            mUnseededTime(0.0f),
+            mBatchSink(nullptr),
             mTree(std::make_unique<tree::BlobTree>(model)),
             mName(name)
-        { }
+        {
+            mTree->freeze();
+        }
 
         Bsoid::Bsoid(Bsoid&& b) :
             mGridDelta(b.mGridDelta),
@@ -43,6 +90,21 @@ namespace bsoid
             mGridSize(b.mGridSize),
             mSvSize(b.mSvSize),
             mMagic(b.mMagic),
+            mLazyGradients(b.mLazyGradients),
+            mStreaming(b.mStreaming),
+            mCompact(b.mCompact),
+            mCodec(b.mCodec),
+            mPeakEdges(b.mPeakEdges),
+            mSeedsUsed(b.mSeedsUsed),
+            mSeedsDuplicate(b.mSeedsDuplicate),
+            mSeedsVisited(b.mSeedsVisited),
+            mSeedsMissed(b.mSeedsMissed),
+            mSeedsGenerated(b.mSeedsGenerated),
+            mGeneratedMissed(b.mGeneratedMissed),
+            mFindUnseeded(b.mFindUnseeded),
+            mUnseededTime(b.mUnseededTime),
+            mTriangleCallback(std::move(b.mTriangleCallback)),
+            mBatchSink(nullptr),
             mLattice(std::move(b.mLattice)),
             mTree(std::move(b.mTree)),
             mMesh(std::move(b.mMesh)),
@@ -53,6 +115,7 @@ namespace bsoid
         void Bsoid::setModel(tree::BlobTree const& model)
         {
             mTree = std::make_unique<tree::BlobTree>(model);
+            mTree->freeze();
         }
 
         void Bsoid::setIsoValue(float isoValue)
@@ -60,6 +123,48 @@ namespace bsoid
             mMagic = isoValue;
         }
 
+        void Bsoid::setLazyGradients(bool lazy)
+        {
+            mLazyGradients = lazy;
+        }
+
+        // When streaming, polygonize triangulates every voxel as soon as the
+        // march reaches it instead of storing it for a second pass. The
+        // lattice is always built from stored voxels.
+        void Bsoid::setStreaming(bool streaming)
+        {
+            mStreaming = streaming;
+        }
+
+        // In compact mode the cached samples are quantized to 16 bits around
+        // the iso-value, and the vertices are kept as a position along their
+        // edge with an oct-encoded normal until the mesh is assembled. The
+        // mesh normals are then unit length, and the log reports how far
+        // any vertex can be from where exact mode puts it.
+        void Bsoid::setCompactCache(bool compact)
+        {
+            mCompact = compact;
+        }
+
+        // Components that none of the seeds of the model reach are found by
+        // sampling every part of the grid that the field bounds cannot rule
+        // out. Models whose seeds cover all of their surface don't need it,
+        // and it costs about as much as the march itself, so it is off by
+        // default.
+        void Bsoid::setFindUnseeded(bool find)
+        {
+            mFindUnseeded = find;
+        }
+
+        // The callback is handed every triangle of the mesh in batches while
+        // polygonize runs, one batch at a time. When streaming, it runs
+        // alongside the march, so the first triangles are out long before
+        // the mesh is done.
+        void Bsoid::setTriangleCallback(TriangleCallback const& callback)
+        {
+            mTriangleCallback = callback;
+        }
+
         void Bsoid::setResolution(std::uint64_t res, std::uint64_t svRes)
         {
             mGridSize = res;
@@ -82,8 +187,8 @@ namespace bsoid
 
         void Bsoid::constructLattice()
         {
-            makeVoxels();
-            mLattice.makeLattice(mVoxels);
+            makeVoxels(false);
+            mLattice.makeLattice(mVoxels, mMin, mGridDelta);
             validateVoxels();
         }
 
@@ -102,15 +207,38 @@ namespace bsoid
             mLog << "Polygonizing model: " << mName << "\n";
             mLog << "Resolution: " << std::to_string(mGridSize) << ", "
                 << std::to_string(mSvSize) << ".\n";
+            mLog << "Field kernels: " << fields::kernels::getIsaName() 
+                << ".\n";
+            mLog << "Cache mode: " << ((mCompact) ? "compact" : "exact") <<
+                ".\n";
             mLog << "#===========================#\n";
 
             global.start();
+
+            // Batches of triangles flow from the march into a serial node
+            // that hands them to the callback, so whoever is consuming the
+            // mesh can get to work while the rest is still being built.
+            float firstBatch = -1.0f;
+            tbb::flow::graph graph;
+            tbb::flow::function_node<BatchPointer> sink(graph,
+                tbb::flow::serial,
+                [this, &global, &firstBatch](BatchPointer const& batch)
+            {
+                if (firstBatch < 0.0f)
+                {
+                    firstBatch = global.elapsed();
+                }
+                mTriangleCallback(*batch);
+                return tbb::flow::continue_msg();
+            });
+            mBatchSink = (mTriangleCallback) ? &sink : nullptr;
+
             INFO_LOG("Bsoid: Starting Lattice generation.");
             // Generate lattices.
             {
                 Timer<float> section;
                 section.start();
-                makeVoxels();
+                makeVoxels(mStreaming);
             }
             INFO_LOG("Bsoid: Lattice generation done.");
 
@@ -120,6 +248,8 @@ namespace bsoid
                 section.start();
                 constructMesh();
             }
+            graph.wait_for_all();
+            mBatchSink = nullptr;
             INFO_LOG("Bsoid: Mesh generation done.");
 
             mLog << "\nSummary:\n";
@@ -127,7 +257,64 @@ namespace bsoid
             mLog << "Total runtime: " << global.elapsed() << " seconds\n";
             mLog << "Total vertices generated: " << mMesh.vertices().size() << "\n";
             mLog << "Total memory usage: " << size() << " bytes\n";
+            mLog << "Total super-voxels generated: " << 
+                mSuperVoxels.numSuperVoxels() << "\n";
+            mLog << "Seeds used: " << mSeedsUsed << " (" << mSeedsDuplicate <<
+                " duplicates, " << mSeedsVisited <<
+                " in marched components, " << mSeedsMissed <<
+                " without a surface)\n";
+            if (mFindUnseeded)
+            {
+                mLog << "Seeds generated: " << mSeedsGenerated << " (" <<
+                    mGeneratedMissed << " without a surface), searched in " <<
+                    mUnseededTime << " seconds\n";
+            }
+            mLog << "Super-voxels pruned: " << mSuperVoxels.numPruned() <<
+                "\n";
+            mLog << "Peak cached crossings: " << mPeakEdges << "\n";
+            if (mCompact)
+            {
+                std::size_t samples = mStoredSamples.combine(
+                    std::plus<std::size_t>());
+                std::size_t vertices = mMesh.vertices().size();
+                std::size_t exact = samples *
+                    BrickSamples::bytesPerSample(!mLazyGradients, false) +
+                    vertices * sizeof(MeshPoint);
+                std::size_t compact = samples *
+                    BrickSamples::bytesPerSample(!mLazyGradients, true) +
+                    vertices * sizeof(PackedMeshPoint);
+                double saved = (exact) ?
+                    100.0 * (exact - compact) / exact : 0.0;
+                mLog << "Cached samples and vertices: " << compact <<
+                    " bytes (exact mode: " << exact << " bytes, " << saved <<
+                    "% saved)\n";
+
+                float bound = mErrorBounds.combine([](float a, float b)
+                {
+                    return std::max(a, b);
+                });
+                mLog << "Vertex error bound: " << bound << " (" <<
+                    bound / glm::compMin(mGridDelta) << " cells)\n";
+            }
+            if (firstBatch >= 0.0f)
+            {
+                mLog << "Time to first triangles: " << firstBatch <<
+                    " seconds\n";
+            }
+            mLog << "Unique subtrees built: " << mSuperVoxels.numSubTrees()
+                << "\n";
+            {
+                auto lookups = mSuperVoxels.subTreeLookups();
+                auto hits = mSuperVoxels.subTreeHits();
+                double rate = (lookups) ? 100.0 * hits / lookups : 0.0;
+                mLog << "Subtree cache hits: " << hits << " of " << lookups
+                    << " (" << rate << "%)\n";
+            }
             mLog << mTree->getFieldSummary();
+
+            // The mesh is done, so the super-voxels and the fields they were
+            // built from can all go at once.
+            mSuperVoxels.clear();
         }
 
         Lattice const& Bsoid::getLattice() const
@@ -167,82 +354,53 @@ namespace bsoid
 
         std::size_t Bsoid::size() const
         {
-            std::size_t voxelSize = mVoxels.size() * sizeof(Voxel);
-            std::size_t seenVoxelSize = mSeenVoxels.size() *
-                sizeof(std::pair<std::uint64_t, VoxelId>);
-            std::size_t seenPointsSize = mSeenPoints.size() *
-                sizeof(std::pair<std::uint64_t, VoxelId>);
-            std::size_t svSize = mSuperVoxels.size() *
-                sizeof(std::pair<std::uint64_t, VoxelId>);
+            std::size_t voxelSize = mVoxels.size() * sizeof(SurfaceVoxel) +
+                mVoxelEdges.size() * sizeof(std::uint32_t);
+            std::size_t svSize = mSuperVoxels.size();
             std::size_t computedSize = mComputedPoints.size() *
-                sizeof(std::pair<std::uint128_t, LinePoint>);
+                sizeof(std::pair<std::uint64_t, std::uint32_t>);
 
-            return voxelSize + seenVoxelSize + seenPointsSize + svSize +
-                computedSize;
+            return voxelSize + svSize + computedSize;
         }
 
-        void Bsoid::makeVoxels()
+        void Bsoid::makeVoxels(bool streaming)
         {
             using atlas::math::Point;
             using atlas::utils::BBox;
 
+            mVoxels.clear();
+            mVoxelEdges.clear();
+            mComputedPoints.clear();
+            mNewEdges.clear();
+            mPeakEdges = 0;
+            mMeshPoints.clear();
+            mPackedPoints.clear();
+            mTriangles.clear();
+            mPendingBatches.clear();
+            mStoredSamples.clear();
+            mSeedsUsed = 0;
+            mSeedsDuplicate = 0;
+            mSeedsVisited = 0;
+            mSeedsMissed = 0;
+            mSeedsGenerated = 0;
+            mGeneratedMissed = 0;
+            mUnseededTime = 0.0f;
+            mErrorBounds.clear();
+            mCodec = SampleCodec(mMagic);
+
             atlas::core::Timer<float> global;
             atlas::core::Timer<float> t;
 
-#if (DISABLE_PARALLEL)
-            for (std::size_t x = 0; x < mSvSize; ++x)
-            {
-                for (std::size_t y = 0; y < mSvSize; ++y)
-                {
-                    for (std::size_t z = 0; z < mSvSize; ++z)
-                    {
-                        auto pt = createCellPoint(x, y, z, mSvDelta);
-                        BBox cell(pt, pt + mSvDelta);
-
-                        SuperVoxel sv;
-                        sv.field = mTree->getSubTree(cell);
-                        sv.id = { x, y, z };
+            // The super-voxel octree is expanded on demand as the march
+            // reaches new cells. The finest cells match the requested
+            // super-voxel resolution.
+            auto minCellSize = std::max(static_cast<std::uint64_t>(2),
+                mGridSize / mSvSize);
+            mSuperVoxels.makeTree(mTree.get(), mMin, mGridDelta, mGridSize,
+                minCellSize, maxSuperVoxelLeaves, mMagic,
+                (mCompact) ? &mCodec : nullptr);
 
-                        if (sv.field)
-                        {
-                            auto idx = BsoidHash64::hash(x, y, z);
-                            mSuperVoxels.insert({ idx, sv });
-                        }
-                    }
-                }
-            }
-
-#else
-            // First construct the grid of super-voxels.
-            tbb::parallel_for(static_cast<std::uint64_t>(0), mSvSize, 
-                [this](std::uint64_t x) {
-                tbb::parallel_for(static_cast<std::uint64_t>(0), mSvSize,
-                    [this, x](std::uint64_t y) {
-                    tbb::parallel_for(static_cast<std::uint64_t>(0), mSvSize,
-                        [this, x, y](std::uint64_t z)
-                    {
-                        auto pt = createCellPoint(x, y, z, mSvDelta);
-                        BBox cell(pt, pt + mSvDelta);
-
-                        SuperVoxel sv;
-                        sv.field = mTree->getSubTree(cell);
-                        sv.id = { x, y, z };
-
-                        if (sv.field)
-                        {
-                            // critical section.
-                            std::lock_guard<std::mutex> lock(mSvMutex);
-                            auto idx = BsoidHash64::hash(x, y, z);
-                            mSuperVoxels.insert({ idx, sv });
-                        }
-                    });
-                });
-            });
-#endif
-
-
-            // Now that we have the grid of super-voxels, we can grab the seeds
-            // and convert them into voxels in parallel.
+            // Now all we need are the seeds converted into voxels.
             auto seedPoints = mTree->getSeeds();
             std::vector<Voxel> seedVoxels(seedPoints.size());
 #if (DISABLE_PARALLEL)
@@ -271,7 +429,140 @@ namespace bsoid
             });
 #endif
 
-            marchVoxelOnSurface(seedVoxels);
+            // Seeds that snap to the same voxel only need to be looked at
+            // once.
+            std::unordered_set<std::uint64_t> seen;
+            std::vector<Voxel> uniqueSeeds;
+            for (auto const& seed : seedVoxels)
+            {
+                if (seen.insert(BsoidHash64::hash(seed.id.x, seed.id.y,
+                    seed.id.z)).second)
+                {
+                    uniqueSeeds.push_back(seed);
+                }
+            }
+            mSeedsDuplicate = seedVoxels.size() - uniqueSeeds.size();
+
+            marchVoxelOnSurface(uniqueSeeds, streaming);
+
+            // Components without a seed of their own are found by looking
+            // for parts of the grid where the field might still reach the
+            // iso-value but that no march has been through. This samples
+            // every such part, the ones along the marched surface included,
+            // so it is only done when asked for.
+            if (mFindUnseeded)
+            {
+                atlas::core::Timer<float> search;
+                search.start();
+                marchUnseeded(VoxelId(0), VoxelId(mGridSize), minCellSize,
+                    streaming);
+                mUnseededTime = search.elapsed();
+            }
+        }
+
+        void Bsoid::marchUnseeded(VoxelId const& start, VoxelId const& end,
+            std::uint64_t leafSize, bool streaming)
+        {
+            using atlas::math::Point;
+            using atlas::utils::BBox;
+
+            // The voxels in [start, end) span the corners [start, end].
+            BBox box(mMin + Point(start) * mGridDelta,
+                mMin + Point(end) * mGridDelta);
+            if (!mTree->evalInterval(box).contains(mMagic))
+            {
+                return;
+            }
+
+            auto size = end - start;
+            if (glm::compMax(size) > leafSize)
+            {
+                auto mid = start + (size + VoxelId(1)) / VoxelId(2);
+                for (std::uint64_t child = 0; child < 8; ++child)
+                {
+                    VoxelId s, e;
+                    s.x = (child & 4) ? mid.x : start.x;
+                    s.y = (child & 2) ? mid.y : start.y;
+                    s.z = (child & 1) ? mid.z : start.z;
+                    e.x = (child & 4) ? end.x : mid.x;
+                    e.y = (child & 2) ? end.y : mid.y;
+                    e.z = (child & 1) ? end.z : mid.z;
+                    if (s.x < e.x && s.y < e.y && s.z < e.z)
+                    {
+                        marchUnseeded(s, e, leafSize, streaming);
+                    }
+                }
+
+                return;
+            }
+
+            // The corners of the range are sampled in one batch, and every
+            // voxel whose corners straddle the iso-value and that no march
+            // has been through starts a march of its own. The flags are
+            // looked at again for every voxel, so a march started here
+            // covers the rest of its component and a second surface in the
+            // same range is still found.
+            auto corners = size + VoxelId(1);
+            std::size_t count = corners.x * corners.y * corners.z;
+            std::vector<float> x(count), y(count), z(count), values(count);
+            std::size_t i = 0;
+            VoxelId id;
+            for (id.x = start.x; id.x <= end.x; ++id.x)
+            {
+                for (id.y = start.y; id.y <= end.y; ++id.y)
+                {
+                    for (id.z = start.z; id.z <= end.z; ++id.z)
+                    {
+                        auto pt = createCellPoint(id, mGridDelta);
+                        x[i] = pt.x;
+                        y[i] = pt.y;
+                        z[i] = pt.z;
+                        ++i;
+                    }
+                }
+            }
+            mTree->evalPoints({ x.data(), y.data(), z.data(), count },
+                values.data());
+
+            auto inside = [&](VoxelId const& corner)
+            {
+                auto offset = corner - start;
+                return values[(offset.x * corners.y + offset.y) * corners.z +
+                    offset.z] < mMagic;
+            };
+
+            for (id.x = start.x; id.x < end.x; ++id.x)
+            {
+                for (id.y = start.y; id.y < end.y; ++id.y)
+                {
+                    for (id.z = start.z; id.z < end.z; ++id.z)
+                    {
+                        std::uint8_t mask = 0;
+                        for (std::size_t d = 0; d < VoxelDecals.size(); ++d)
+                        {
+                            mask |= inside(id + VoxelDecals[d]) ?
+                                (1 << d) : 0;
+                        }
+
+                        if (mask == 0 || mask == 0xff || visitedVoxel(id))
+                        {
+                            continue;
+                        }
+
+                        // The march sees the samples as they are cached,
+                        // which in compact mode can round the crossing away.
+                        Voxel seed(id);
+                        if (!probeSurface(seed))
+                        {
+                            ++mGeneratedMissed;
+                            continue;
+                        }
+
+                        ++mSeedsGenerated;
+                        marchFrom(seed, streaming);
+                    }
+                }
+            }
         }
 
 
@@ -292,90 +583,220 @@ namespace bsoid
             return createCellPoint(p.x, p.y, p.z, delta);
         }
 
-        FieldPoint Bsoid::findVoxelPoint(PointId const& id)
+        std::size_t Bsoid::touchedSuperVoxels(VoxelId const& id,
+            std::array<SuperVoxel*, 8>& svs)
         {
-            using atlas::math::Point4;
-            using atlas::math::Point;
-
-            // First check if we have seen this point before.
-            auto entry = mSeenPoints.find(BsoidHash64::hash(id.x, id.y, id.z));
-            if (entry != mSeenPoints.end())
+            std::size_t count = 0;
+            for (auto& decal : VoxelDecals)
             {
-                return (*entry).second;
+                auto sv = &mSuperVoxels.find(id + decal);
+                if (std::find(svs.begin(), svs.begin() + count, sv) ==
+                    svs.begin() + count)
+                {
+                    svs[count++] = sv;
+                }
             }
-            else
+
+            return count;
+        }
+
+        bool Bsoid::findVoxelPoint(PointId const& id, FieldPoint& point)
+        {
+            using atlas::math::Normal;
+
+            auto pt = createCellPoint(id, mGridDelta);
+            auto& sv = mSuperVoxels.find(id);
+
+            // The gradients at the corners are never used for the mesh, since
+            // interpolate evaluates them again at the crossing point. So
+            // unless they are explicitly asked for, only the value is
+            // computed and cached.
+            float val = 0.0f;
+            Normal g(0);
+            bool found = (mLazyGradients) ? sv.findSample(id, val) :
+                sv.findSample(id, val, g);
+
+            point = FieldPoint(pt, val, g, static_cast<std::uint32_t>(sv.id));
+            return found;
+        }
+
+        void Bsoid::fillVoxel(Voxel& v)
+        {
+            std::array<std::size_t, 8> missing;
+            std::size_t numMissing = 0;
+            for (std::size_t d = 0; d < VoxelDecals.size(); ++d)
             {
-                auto pt = createCellPoint(id, mGridDelta);
+                if (!findVoxelPoint(v.id + VoxelDecals[d], v.points[d]))
+                {
+                    missing[numMissing++] = d;
+                }
+            }
 
-                PointId svId;
+            // Whatever we haven't seen before is evaluated in batches, one
+            // per super-voxel that the missing corners fall in.
+            float x[8], y[8], z[8], values[8], gx[8], gy[8], gz[8];
+            std::array<std::size_t, 8> batch;
+            while (numMissing != 0)
+            {
+                auto svIndex = v.points[missing[0]].svIndex;
+                std::size_t size = 0, rest = 0;
+                for (std::size_t i = 0; i < numMissing; ++i)
                 {
-                    auto v = (pt - mMin) / mSvDelta;
-                    svId.x = static_cast<std::uint64_t>(v.x);
-                    svId.y = static_cast<std::uint64_t>(v.y);
-                    svId.z = static_cast<std::uint64_t>(v.z);
+                    auto d = missing[i];
+                    if (v.points[d].svIndex != svIndex)
+                    {
+                        missing[rest++] = d;
+                        continue;
+                    }
 
-                    // Check any of the coordinates of the id are beyond the edge
-                    // of the grid.
-                    svId.x = (svId.x < mSvSize) ? svId.x : svId.x - 1;
-                    svId.y = (svId.y < mSvSize) ? svId.y : svId.y - 1;
-                    svId.z = (svId.z < mSvSize) ? svId.z : svId.z - 1;
+                    auto const& pt = v.points[d].value;
+                    x[size] = pt.x;
+                    y[size] = pt.y;
+                    z[size] = pt.z;
+                    batch[size++] = d;
                 }
+                numMissing = rest;
 
-                FieldPoint fp;
+                auto& sv = mSuperVoxels[svIndex];
+                fields::PointSpan points = { x, y, z, size };
+                if (mLazyGradients)
                 {
-                    auto svHash = BsoidHash64::hash(svId.x, svId.y, svId.z);
-                    SuperVoxel sv = mSuperVoxels.at(svHash);
-                    auto val = sv.eval(pt);
-                    auto g = sv.grad(pt);
-                    fp = { pt, val, g, svHash };
+                    sv.evalBatch(points, values);
                 }
-
-                // Now that we have the point, let's add it to our list and
-                // return it.
+                else
                 {
-                    std::lock_guard<std::mutex> lock(mSeenPointsMutex);
-                    auto hash = BsoidHash64::hash(id.x, id.y, id.z);
-                    mSeenPoints.insert(
-                        std::pair<std::uint64_t, FieldPoint>(hash, fp));
+                    sv.evalGradBatch(points, values, { gx, gy, gz });
                 }
 
-                return fp;
+                // In compact mode we carry on with the value as it is
+                // stored, so that every voxel sharing this corner sees the
+                // same one.
+                mStoredSamples.local() += size;
+                for (std::size_t i = 0; i < size; ++i)
+                {
+                    auto d = batch[i];
+                    auto id = v.id + VoxelDecals[d];
+                    auto& point = v.points[d];
+                    point.value.w = (mCompact) ? mCodec.quantize(values[i]) :
+                        values[i];
+                    if (mLazyGradients)
+                    {
+                        sv.storeSample(id, values[i]);
+                    }
+                    else
+                    {
+                        point.g = { gx[i], gy[i], gz[i] };
+                        sv.storeSample(id, values[i], point.g);
+                    }
+                }
             }
         }
 
-        void Bsoid::fillVoxel(Voxel& v)
+        // Newton's method along the gradient of the field. Steps are
+        // capped, and halved whenever they don't bring us any closer to the
+        // surface, so a poor gradient can't throw the search far off. The
+        // search gives up if the gradient vanishes, if it leaves the grid,
+        // or if it stops making progress.
+        bool Bsoid::findSurfacePoint(atlas::math::Point const& start,
+            atlas::math::Point& surface)
         {
-#if (DISABLE_PARALLEL)
-            std::size_t d = 0;
-            for (auto& id : VoxelDecals)
+            float maxStep = maxSeedStep * glm::compMax(mGridDelta);
+            float tolerance = 0.1f * glm::compMin(mGridDelta);
+
+            auto p = start;
+            auto fv = mTree->evalGrad(p);
+            float f = fv.value - mMagic;
+            for (int i = 0; i < maxSeedIterations; ++i)
             {
-                auto decalId = v.id + id;
-                v.points[d] = findVoxelPoint(decalId);
-                ++d;
+                float g2 = glm::dot(fv.g, fv.g);
+                if (f == 0.0f)
+                {
+                    surface = p;
+                    return true;
+                }
+
+                if (g2 == 0.0f || !std::isfinite(g2))
+                {
+                    return false;
+                }
+
+                auto step = (-f / g2) * fv.g;
+                float length = glm::length(step);
+                if (length > maxStep)
+                {
+                    step *= maxStep / length;
+                }
+
+                bool improved = false;
+                for (int k = 0; k < 4 && !improved; ++k)
+                {
+                    auto q = p + step;
+                    if (q.x < mMin.x || q.y < mMin.y || q.z < mMin.z ||
+                        q.x > mMax.x || q.y > mMax.y || q.z > mMax.z)
+                    {
+                        step *= 0.5f;
+                        continue;
+                    }
+
+                    auto next = mTree->evalGrad(q);
+                    float fq = next.value - mMagic;
+                    if (std::abs(fq) < std::abs(f) || fq * f <= 0.0f)
+                    {
+                        p = q;
+                        fv = next;
+                        f = fq;
+                        improved = true;
+                    }
+                    else
+                    {
+                        step *= 0.5f;
+                    }
+                }
+
+                if (!improved)
+                {
+                    return false;
+                }
+
+                if (glm::length(step) < tolerance)
+                {
+                    surface = p;
+                    return true;
+                }
             }
-#else
-            tbb::parallel_for(static_cast<std::size_t>(0), 
-                VoxelDecals.size(), [this, &v](std::size_t d) {
-                auto decalId = v.id + VoxelDecals[d];
-                v.points[d] = findVoxelPoint(decalId);
-            });
-#endif
+
+            return false;
+        }
+
+        bool Bsoid::visitedVoxel(VoxelId const& id)
+        {
+            return mSuperVoxels.find(id).visitedVoxel(id);
         }
 
-        bool Bsoid::seenVoxel(VoxelId const& id)
+        bool Bsoid::claimVoxel(VoxelId const& id)
         {
-            if (mSeenVoxels.find(BsoidHash64::hash(id.x, id.y, id.z)) !=
-                mSeenVoxels.end())
+            // Setting the visited flag is atomic, so only one thread can ever
+            // succeed in claiming a given voxel.
+            return mSuperVoxels.find(id).claimVoxel(id);
+        }
+
+        void Bsoid::acquireVoxel(VoxelId const& id)
+        {
+            std::array<SuperVoxel*, 8> svs;
+            auto count = touchedSuperVoxels(id, svs);
+            for (std::size_t i = 0; i < count; ++i)
             {
-                return true;
+                svs[i]->acquire();
             }
-            else
+        }
+
+        void Bsoid::releaseVoxel(VoxelId const& id)
+        {
+            std::array<SuperVoxel*, 8> svs;
+            auto count = touchedSuperVoxels(id, svs);
+            for (std::size_t i = 0; i < count; ++i)
             {
-                std::lock_guard<std::mutex> lock(mSeenVoxelsMutex);
-                mSeenVoxels.insert(
-                    std::pair<std::uint64_t, VoxelId>(
-                        BsoidHash64::hash(id.x, id.y, id.z), id));
-                return false;
+                svs[i]->release();
             }
         }
 
@@ -384,582 +805,690 @@ namespace bsoid
             auto pt = glm::mix(p1.value.xyz(), p2.value.xyz(),
                 (mMagic - p1.value.w) / (p2.value.w - p1.value.w));
 
-            auto hash = p1.svHash;
-            auto sv = mSuperVoxels[hash];
-            auto val = sv.eval(pt);
-            auto grad = sv.grad(pt);
-            return FieldPoint(pt, val, grad, hash);
+            auto const& sv = mSuperVoxels[p1.svIndex];
+            auto v = sv.evalGrad(pt);
+            return FieldPoint(pt, v.value, v.g, p1.svIndex);
         }
 
-        Bsoid::LinePoint Bsoid::generateLinePoint(PointId const& p1, 
+        std::uint32_t Bsoid::generateLinePoint(PointId const& p1,
             PointId const& p2, FieldPoint const& fp1, FieldPoint const& fp2)
         {
-            auto h1 = BsoidHash64::hash(p1.x, p1.y, p1.z);
-            auto h2 = BsoidHash64::hash(p2.x, p2.y, p2.z);
+            // The crossing is always measured from the lower corner of the
+            // edge, so it comes out the same whichever voxel gets to it
+            // first.
+            auto edgeHash = BsoidEdgeHash64::hash(p1, p2);
+            bool flip = p2.x < p1.x || p2.y < p1.y || p2.z < p1.z;
+            auto const& lo = (flip) ? fp2 : fp1;
+            auto const& hi = (flip) ? fp1 : fp2;
+            return mComputedPoints.findOrCreate(edgeHash, 
+                [this, edgeHash, &lo, &hi]()
+            {
+                mNewEdges.push_back(edgeHash);
+                if (mCompact)
+                {
+                    return packLinePoint(edgeHash, lo, hi);
+                }
+
+                auto pt = interpolate(lo, hi);
+                auto it = mMeshPoints.push_back({ pt.value.xyz(), -pt.g });
+                return static_cast<std::uint32_t>(it - mMeshPoints.begin());
+            });
+        }
+
+        std::uint32_t Bsoid::packLinePoint(std::uint64_t edge,
+            FieldPoint const& lo, FieldPoint const& hi)
+        {
+            float t = (mMagic - lo.value.w) / (hi.value.w - lo.value.w);
+            auto packedT = static_cast<std::uint16_t>(std::round(
+                glm::clamp(t, 0.0f, 1.0f) * 65535.0f));
+
+            auto pt = edgePoint(edge, packedT);
+            auto const& sv = mSuperVoxels[lo.svIndex];
+            auto normal = -sv.grad(pt);
+
+            // Each end can be off by at most one step of the codec, which
+            // moves the crossing by at most one over the number of steps
+            // between the ends. Storing t adds half a unit on top of that.
+            auto q1 = mCodec.encode(lo.value.w);
+            auto q2 = mCodec.encode(hi.value.w);
+            float bound = 1.0f;
+            if (!SampleCodec::clamped(q1) && !SampleCodec::clamped(q2))
+            {
+                bound = std::min(1.0f, 1.0f / std::abs(q2 - q1) +
+                    0.5f / 65535.0f);
+            }
+            bound *= mGridDelta[BsoidEdgeHash64::axis(edge)];
+            auto& maxBound = mErrorBounds.local();
+            maxBound = std::max(maxBound, bound);
 
-            auto edgeHash1 = BsoidHash128::hash(h1, h2);
-            auto edgeHash2 = BsoidHash128::hash(h2, h1);
+            auto it = mPackedPoints.push_back({ edge, packedT,
+                encodeOct(normal) });
+            return static_cast<std::uint32_t>(it - mPackedPoints.begin());
+        }
 
-            auto entry1 = mComputedPoints.find(edgeHash1);
-            auto entry2 = mComputedPoints.find(edgeHash2);
+        atlas::math::Point Bsoid::edgePoint(std::uint64_t edge,
+            std::uint16_t t) const
+        {
+            atlas::math::Point p(BsoidEdgeHash64::corner(edge));
+            p[BsoidEdgeHash64::axis(edge)] += t / 65535.0f;
+            return mMin + p * mGridDelta;
+        }
 
-            if (entry1 != mComputedPoints.end() ||
-                entry2 != mComputedPoints.end())
+        void Bsoid::getVertex(std::uint32_t index,
+            atlas::math::Point& position, atlas::math::Normal& normal) const
+        {
+            if (mCompact)
             {
-                if (entry1 != mComputedPoints.end())
-                {
-                    return (*entry1).second;
-                }
-                
-                return (*entry2).second;
+                auto const& point = mPackedPoints[index];
+                position = edgePoint(point.edge, point.t);
+                normal = decodeOct(point.normal);
             }
             else
             {
-                auto edgeHash = edgeHash1;
-                auto pt = interpolate(fp1, fp2);
-
-                LinePoint p(pt, edgeHash);
-                std::lock_guard<std::mutex> lock(mPointMutex);
-                mComputedPoints.insert(
-                    std::pair<std::uint128_t, LinePoint>(edgeHash, p));
-                return p;
+                auto const& point = mMeshPoints[index];
+                position = point.position;
+                normal = point.normal;
             }
         }
 
-        void Bsoid::marchVoxelOnSurface(std::vector<Voxel> const& seeds)
+        // The faces of a voxel that the surface crosses, as a bit mask of
+        // indices into NeighbourDecals.
+        std::uint8_t Bsoid::getFaces(Voxel const& v) const
         {
-            using atlas::math::Point4;
-            using atlas::math::Point;
+            return NeighbourFaceTable[voxelMask(v)];
+        }
 
-            auto getEdges = [this](Voxel const& v)
+        // A probe takes its own reference on the super-voxels the voxel
+        // touches while it fills it, so that the samples it stores are
+        // released with everything else. When the surface is there the
+        // reference is kept, for the caller to hand on to the march or
+        // release.
+        bool Bsoid::probeSurface(Voxel const& v)
+        {
+            Voxel voxel = v;
+            acquireVoxel(voxel.id);
+            fillVoxel(voxel);
+            if (getFaces(voxel) != 0)
             {
-                int edgeId = 0;
-                std::vector<int> edges;
-                std::mutex edgesMutex;
-#if (DISABLE_PARALLEL)
-                FieldPoint start, end;
-                for (auto& decal : EdgeDecals)
-                {
-                    start = v.points[decal.x];
-                    end = v.points[decal.y];
-                    float val1 = start.value.w - mMagic;
-                    float val2 = end.value.w - mMagic;
-
-                    if (glm::sign(val1) != glm::sign(val2))
-                    {
-                        auto map = NeighbourMap[edgeId];
-                        edges.insert(edges.end(), map.begin(), map.end());
-                    }
-                    edgeId++;
-                }
-#else
-                tbb::parallel_for(static_cast<std::size_t>(0), EdgeDecals.size(),
-                    [this, &edges, &edgesMutex, &v](std::size_t edgeId)
-                    {
-                        FieldPoint start, end;
-                        auto decal = EdgeDecals[edgeId];
-                        start = v.points[decal.x];
-                        end = v.points[decal.y];
-                        float val1 = start.value.w - mMagic;
-                        float val2 = end.value.w - mMagic;
-
-                        if (glm::sign(val1) != glm::sign(val2))
-                        {
-                            auto map = NeighbourMap[edgeId];
-                            std::lock_guard<std::mutex> lock(edgesMutex);
-                            edges.insert(edges.end(), map.begin(), map.end());
-                        }
+                return true;
+            }
 
-                    });
-#endif
+            releaseVoxel(voxel.id);
+            return false;
+        }
 
-                return edges;
-            };
+        // Takes v to a voxel with the surface in it, holding a reference on
+        // it. Every voxel the search lands on is checked against the
+        // visited flags before it is filled, so a seed in a component that
+        // has been marched already costs a Newton search and no samples.
+        Bsoid::SeedResult Bsoid::findSurface(Voxel& v)
+        {
+            using atlas::math::Point;
 
-            if (seeds.empty())
+            if (visitedVoxel(v.id))
             {
-                return;
+                return SeedResult::Visited;
             }
 
-            std::queue<VoxelId> frontier;
-            std::mutex frontierMutex;
+            // Jump close to the surface first. If the voxel we land in
+            // doesn't have the surface, or the search fails, the walk below
+            // takes over from wherever we are.
+            auto centre = createCellPoint(
+                static_cast<std::uint64_t>(2) * v.id +
+                glm::u64vec3(1, 1, 1), mGridDelta / 2.0f);
+            Point surface;
+            if (findSurfacePoint(centre, surface))
             {
-                auto containsSurface = [this, getEdges](Voxel const& v)
+                auto cell = (surface - mMin) / mGridDelta;
+                for (int k = 0; k < 3; ++k)
                 {
-                    Voxel voxel = v;
-                    fillVoxel(voxel);
-                    auto edges = getEdges(voxel);
-                    return !edges.empty();
-                };
+                    v.id[k] = std::min(mGridSize - 1,
+                        static_cast<std::uint64_t>(std::max(0.0f, cell[k])));
+                }
 
-                auto findSurface = [this, containsSurface](Voxel const& v)
+                if (visitedVoxel(v.id))
                 {
-                    bool found = false;
-                    Voxel last, current;
-                    current = v;
+                    return SeedResult::Visited;
+                }
+            }
 
-                    while (!found)
-                    {
-                        auto cPos = (static_cast<std::uint64_t>(2) * current.id) + glm::u64vec3(1, 1, 1);
-                        Point origin = createCellPoint(cPos, mGridDelta / 2.0f);
-                        float originVal = mTree->eval(origin);
-                        auto norm = mTree->grad(origin);
-                        norm = glm::normalize(norm);
-                        norm = (originVal > mMagic) ? -norm : norm;
-
-                        // Now find the voxel that we are pointing to.
-                        glm::ivec3 next = glm::sign(norm);
-
-                        current.id.x += static_cast<std::uint64_t>(next.x);
-                        current.id.y += static_cast<std::uint64_t>(next.y);
-                        current.id.z += static_cast<std::uint64_t>(next.z);
-
-                        // Check if the voxel hasn't run off the edge of the grid.
-                        if (!validVoxel(current))
-                        {
-                            break;
-                        }
+            if (probeSurface(v))
+            {
+                return SeedResult::Found;
+            }
 
-                        if (containsSurface(current))
-                        {
-                            break;
-                        }
-                    }
+            // The walk can be sent back and forth between two voxels where
+            // the field is nearly flat, so it is given no more steps than it
+            // takes to cross the grid.
+            for (std::uint64_t step = 0; step < 3 * mGridSize; ++step)
+            {
+                auto cPos = (static_cast<std::uint64_t>(2) * v.id) +
+                    glm::u64vec3(1, 1, 1);
+                Point origin = createCellPoint(cPos, mGridDelta / 2.0f);
+                float originVal = mTree->eval(origin);
+                auto norm = mTree->grad(origin);
+                norm = glm::normalize(norm);
+                norm = (originVal > mMagic) ? -norm : norm;
+
+                // Now find the voxel that we are pointing to. Where the
+                // field is flat there is nowhere to go.
+                glm::ivec3 next = glm::sign(norm);
+                if (next == glm::ivec3(0))
+                {
+                    break;
+                }
 
-                    return current;
-                };
+                v.id.x += static_cast<std::uint64_t>(next.x);
+                v.id.y += static_cast<std::uint64_t>(next.y);
+                v.id.z += static_cast<std::uint64_t>(next.z);
 
-#if (DISABLE_PARALLEL)
-                std::size_t i = 0;
-                for (auto& seed : seeds)
+                // Check if the voxel hasn't run off the edge of the grid.
+                if (!validVoxel(v))
                 {
-                    auto v = seeds[i];
-                    if (!containsSurface(seed))
-                    {
-                        v = findSurface(v);
-                        if (!validVoxel(v))
-                        {
-                            return;
-                        }
-                    }
-                    frontier.push(v.id);
-                    ++i;
+                    break;
                 }
-#else
-                tbb::parallel_for(static_cast<std::size_t>(0), seeds.size(),
-                    [this, containsSurface, findSurface, &frontierMutex, 
-                    &frontier, seeds](std::size_t i) {
-                    auto& seed = seeds[i];
-                    auto v = seeds[i];
-                    if (!containsSurface(seed))
-                    {
-                        v = findSurface(v);
-                        if (!validVoxel(v))
-                        {
-                            return;
-                        }
-                    }
 
-                    {
-                        std::lock_guard<std::mutex> lock(frontierMutex);
-                        frontier.push(v.id);
-                    }
-                });
-#endif
+                if (visitedVoxel(v.id))
+                {
+                    return SeedResult::Visited;
+                }
+
+                if (probeSurface(v))
+                {
+                    return SeedResult::Found;
+                }
             }
 
-            // See whether there is a sensible way of parallelizing this later.
-            if (frontier.empty())
+            return SeedResult::Missed;
+        }
+
+        Bsoid::SeedResult Bsoid::marchSeed(Voxel const& seed, bool streaming)
+        {
+            auto v = seed;
+            auto result = findSurface(v);
+            if (result != SeedResult::Found)
             {
-                DEBUG_LOG("Exiting on empty queue.");
-                return;
+                return result;
             }
 
-            while (!frontier.empty())
-            {
-                auto top = frontier.front();
-                frontier.pop();
+            return (marchFrom(v, streaming)) ? SeedResult::Found :
+                SeedResult::Visited;
+        }
 
-                if (seenVoxel(top))
-                {
-                    continue;
-                }
+        // Marches the component through a voxel that has just been probed,
+        // handing the reference the probe took on to the march.
+        bool Bsoid::marchFrom(Voxel const& v, bool streaming)
+        {
+            if (!claimVoxel(v.id))
+            {
+                releaseVoxel(v.id);
+                return false;
+            }
 
-                Voxel v(top);
-                fillVoxel(v);
+            tbb::concurrent_vector<VoxelId> frontier;
+            frontier.push_back(v.id);
+            marchFrontier(frontier, streaming);
+            return true;
+        }
 
-                auto edges = getEdges(v);
-                if (edges.empty())
+        void Bsoid::marchVoxelOnSurface(std::vector<Voxel> const& seeds,
+            bool streaming)
+        {
+            // Seeds are taken one at a time. Each one that reaches a part of
+            // the surface nobody has marched yet is marched to completion
+            // before we look at the next.
+            for (auto const& seed : seeds)
+            {
+                if (!validVoxel(seed))
                 {
+                    ++mSeedsMissed;
                     continue;
                 }
 
-#if (DISABLE_PARALLEL)
-                for (auto& edge : edges)
+                switch (marchSeed(seed, streaming))
                 {
-                    auto decal = NeighbourDecals[edge];
+                case SeedResult::Found:
+                    ++mSeedsUsed;
+                    break;
+                case SeedResult::Visited:
+                    ++mSeedsVisited;
+                    break;
+                default:
+                    ++mSeedsMissed;
+                    break;
+                }
+            }
+        }
 
-                    auto neighbourDecal = v.id;
-                    neighbourDecal.x += decal.x;
-                    neighbourDecal.y += decal.y;
-                    neighbourDecal.z += decal.z;
+        void Bsoid::marchFrontier(tbb::concurrent_vector<VoxelId>& frontier,
+            bool streaming)
+        {
+            // The frontier is marched one level at a time. Every voxel is
+            // claimed exactly once (when it is pushed), so each level can be
+            // processed in parallel without any further synchronization, and
+            // the set of voxels that we end up with is the same as the one
+            // produced by a serial breadth-first march. Voxels in the
+            // frontier also keep the bricks of the super-voxels they touch
+            // alive until they have been processed.
+            //
+            // When streaming, each voxel is triangulated as soon as it is
+            // filled. The voxels around a crossed edge are face neighbours
+            // of each other, so they are all marched within two levels of
+            // the first one to compute the crossing. Two levels after a
+            // crossing was made it can therefore be dropped, which keeps
+            // the cache as wide as the frontier rather than as large as the
+            // surface.
+            std::deque<std::vector<std::uint64_t>> edgeLevels;
+            while (!frontier.empty())
+            {
+                tbb::concurrent_vector<VoxelId> nextFrontier;
+                tbb::concurrent_vector<SurfaceVoxel> surfaceVoxels;
 
-                    if (!validVoxel(Voxel(neighbourDecal)))
-                    {
-                        continue;
-                    }
-                    frontier.push(neighbourDecal);
-                }
-#else
-                tbb::parallel_for(static_cast<std::size_t>(0), edges.size(),
-                    [v, &frontier, &frontierMutex, edges, this](std::size_t i)
+                auto marchVoxel = [this, streaming, &nextFrontier,
+                    &surfaceVoxels](VoxelId const& id)
                 {
-                    auto decal = NeighbourDecals[edges[i]];
-
-                    auto neighbourDecal = v.id;
-                    neighbourDecal.x += decal.x;
-                    neighbourDecal.y += decal.y;
-                    neighbourDecal.z += decal.z;
+                    Voxel v(id);
+                    fillVoxel(v);
 
-                    if (!validVoxel(Voxel(neighbourDecal)))
+                    auto faces = getFaces(v);
+                    if (faces == 0)
                     {
+                        releaseVoxel(id);
                         return;
                     }
 
+                    for (std::size_t face = 0; face < NeighbourDecals.size();
+                        ++face)
                     {
-                        std::lock_guard<std::mutex> lock(frontierMutex);
-                        frontier.push(neighbourDecal);
-                    }
-                });
-#endif
+                        if (!(faces & (1 << face)))
+                        {
+                            continue;
+                        }
 
-                mVoxels.push_back(v);
-            }
-        }
+                        auto decal = NeighbourDecals[face];
 
-        void Bsoid::makeTriangles()
-        {
-            using atlas::math::Point;
-            using atlas::math::Normal;
+                        auto neighbourDecal = v.id;
+                        neighbourDecal.x += decal.x;
+                        neighbourDecal.y += decal.y;
+                        neighbourDecal.z += decal.z;
 
-            // Iterate over the set of voxels.
-            std::map<std::uint128_t, std::uint32_t> indexMap;
+                        if (!validVoxel(Voxel(neighbourDecal)))
+                        {
+                            continue;
+                        }
 
+                        if (claimVoxel(neighbourDecal))
+                        {
+                            acquireVoxel(neighbourDecal);
+                            nextFrontier.push_back(neighbourDecal);
+                        }
+                    }
+
+                    // Our neighbours have taken their own references by now,
+                    // so anything we were the last user of can be retired.
+                    releaseVoxel(id);
+
+                    if (streaming)
+                    {
+                        emitVoxel(v);
+                    }
+                    else
+                    {
+                        surfaceVoxels.push_back(makeSurfaceVoxel(v));
+                    }
+                };
 
 #if (DISABLE_PARALLEL)
-            for (auto& voxel : mVoxels)
-            {
-                std::uint32_t voxelIndex = 0;
-                std::vector<std::uint32_t> coeffs =
-                { 1, 2, 4, 8, 16, 32, 64, 128 };
-                for (std::size_t i = 0; i < voxel.points.size(); ++i)
+                for (auto& id : frontier)
                 {
-                    voxelIndex |= (voxel.points[i].value.w < mMagic) ?
-                        coeffs[i] : 0;
+                    marchVoxel(id);
                 }
-
-                if (EdgeTable[voxelIndex] == 0)
+#else
+                tbb::parallel_for(static_cast<std::size_t>(0), frontier.size(),
+                    [&frontier, marchVoxel](std::size_t i)
                 {
-                    continue;
-                }
+                    marchVoxel(frontier[i]);
+                });
+#endif
 
-                std::vector<LinePoint> vertList(12);
-                if (EdgeTable[voxelIndex] & 1)
-                {
-                    vertList[0] = generateLinePoint(
-                        voxel.id + VoxelDecals[0],
-                        voxel.id + VoxelDecals[1],
-                        voxel.points[0],
-                        voxel.points[1]);
-                }
+                mVoxels.insert(mVoxels.end(), surfaceVoxels.begin(),
+                    surfaceVoxels.end());
+                frontier.swap(nextFrontier);
 
-                if (EdgeTable[voxelIndex] & 2)
+                if (!streaming)
                 {
-                    vertList[1] = generateLinePoint(
-                        voxel.id + VoxelDecals[1],
-                        voxel.id + VoxelDecals[2],
-                        voxel.points[1],
-                        voxel.points[2]);
+                    continue;
                 }
 
-                if (EdgeTable[voxelIndex] & 4)
+                mPeakEdges = std::max(mPeakEdges, mComputedPoints.size());
+                edgeLevels.emplace_back(mNewEdges.begin(), mNewEdges.end());
+                mNewEdges.clear();
+                if (edgeLevels.size() > 2)
                 {
-                    vertList[2] = generateLinePoint(
-                        voxel.id + VoxelDecals[2],
-                        voxel.id + VoxelDecals[3],
-                        voxel.points[2],
-                        voxel.points[3]);
+                    for (auto edge : edgeLevels.front())
+                    {
+                        mComputedPoints.erase(edge);
+                    }
+                    edgeLevels.pop_front();
                 }
+            }
 
-                if (EdgeTable[voxelIndex] & 8)
+            // Whatever crossings are left were made by this component, and
+            // nothing else will ever look them up.
+            for (auto const& level : edgeLevels)
+            {
+                for (auto edge : level)
                 {
-                    vertList[3] = generateLinePoint(
-                        voxel.id + VoxelDecals[3],
-                        voxel.id + VoxelDecals[0],
-                        voxel.points[3],
-                        voxel.points[0]);
+                    mComputedPoints.erase(edge);
                 }
+            }
+        }
 
-                if (EdgeTable[voxelIndex] & 16)
+        void Bsoid::makeTriangles()
+        {
+            // Voxels that the march kept are triangulated now. Their
+            // crossings were found during the march, so this is only a walk
+            // through the triangle table. When streaming, the march has done
+            // all of it already, so all that is left is to gather the
+            // results.
+#if (DISABLE_PARALLEL)
+            for (auto& voxel : mVoxels)
+            {
+                emitVoxel(voxel);
+            }
+#else
+            tbb::parallel_for(static_cast<std::size_t>(0), mVoxels.size(),
+                [this](std::size_t i)
+            {
+                emitVoxel(mVoxels[i]);
+            });
+#endif
+            flushTriangles();
+
+            // Every crossing got its vertex index when it was computed, and
+            // each thread wrote its triangles into a buffer of its own. The
+            // indices carry on from whatever is already in the mesh.
+            auto base = static_cast<std::uint32_t>(mMesh.vertices().size());
+            auto& indices = mMesh.indices();
+            mTriangles.combine_each(
+                [base, &indices](std::vector<std::uint32_t> const& buffer)
+            {
+                for (auto index : buffer)
                 {
-                    vertList[4] = generateLinePoint(
-                        voxel.id + VoxelDecals[4],
-                        voxel.id + VoxelDecals[5],
-                        voxel.points[4],
-                        voxel.points[5]);
+                    indices.push_back(base + index);
                 }
+            });
 
-                if (EdgeTable[voxelIndex] & 32)
-                {
-                    vertList[5] = generateLinePoint(
-                        voxel.id + VoxelDecals[5],
-                        voxel.id + VoxelDecals[6],
-                        voxel.points[5],
-                        voxel.points[6]);
-                }
+            auto& vertices = mMesh.vertices();
+            auto& normals = mMesh.normals();
+            auto numPoints = (mCompact) ? mPackedPoints.size() :
+                mMeshPoints.size();
+            for (std::size_t i = 0; i < numPoints; ++i)
+            {
+                atlas::math::Point position;
+                atlas::math::Normal normal;
+                getVertex(static_cast<std::uint32_t>(i), position, normal);
+                vertices.push_back(position);
+                normals.push_back(normal);
+            }
 
-                if (EdgeTable[voxelIndex] & 64)
-                {
-                    vertList[6] = generateLinePoint(
-                        voxel.id + VoxelDecals[6],
-                        voxel.id + VoxelDecals[7],
-                        voxel.points[6],
-                        voxel.points[7]);
-                }
+            mPeakEdges = std::max(mPeakEdges, mComputedPoints.size());
+            mComputedPoints.clear();
+            mVoxels.clear();
+            mVoxelEdges.clear();
+            mNewEdges.clear();
+            mMeshPoints.clear();
+            mPackedPoints.clear();
+            mTriangles.clear();
+        }
 
-                if (EdgeTable[voxelIndex] & 128)
-                {
-                    vertList[7] = generateLinePoint(
-                        voxel.id + VoxelDecals[7],
-                        voxel.id + VoxelDecals[4],
-                        voxel.points[7],
-                        voxel.points[4]);
-                }
+        void Bsoid::emitVoxel(Voxel const& voxel)
+        {
+            auto mask = voxelMask(voxel);
+            if (EdgeTable[mask] == 0)
+            {
+                return;
+            }
 
-                if (EdgeTable[voxelIndex] & 256)
-                {
-                    vertList[8] = generateLinePoint(
-                        voxel.id + VoxelDecals[0],
-                        voxel.id + VoxelDecals[4],
-                        voxel.points[0],
-                        voxel.points[4]);
-                }
+            std::array<std::uint32_t, 12> edges;
+            findCrossings(voxel, mask, edges);
+            emitTriangles(mask, edges);
+        }
 
-                if (EdgeTable[voxelIndex] & 512)
+        void Bsoid::emitVoxel(SurfaceVoxel const& voxel)
+        {
+            std::array<std::uint32_t, 12> edges;
+            auto next = mVoxelEdges.begin() + voxel.firstEdge;
+            auto crossed = EdgeTable[voxel.mask];
+            for (std::size_t e = 0; e < edges.size(); ++e)
+            {
+                if (crossed & (1 << e))
                 {
-                    vertList[9] = generateLinePoint(
-                        voxel.id + VoxelDecals[1],
-                        voxel.id + VoxelDecals[5],
-                        voxel.points[1],
-                        voxel.points[5]);
+                    edges[e] = *next++;
                 }
+            }
 
-                if (EdgeTable[voxelIndex] & 1024)
-                {
-                    vertList[10] = generateLinePoint(
-                        voxel.id + VoxelDecals[2],
-                        voxel.id + VoxelDecals[6],
-                        voxel.points[2],
-                        voxel.points[6]);
-                }
+            emitTriangles(voxel.mask, edges);
+        }
 
-                if (EdgeTable[voxelIndex] & 2048)
-                {
-                    vertList[11] = generateLinePoint(
-                        voxel.id + VoxelDecals[3],
-                        voxel.id + VoxelDecals[7],
-                        voxel.points[3],
-                        voxel.points[7]);
-                }
+        void Bsoid::emitTriangles(std::uint8_t mask,
+            std::array<std::uint32_t, 12> const& edges)
+        {
+            auto& indices = mTriangles.local();
+            auto first = indices.size();
+            for (int i = 0; TriangleTable[mask][i] != -1; ++i)
+            {
+                indices.push_back(edges[TriangleTable[mask][i]]);
+            }
 
-                for (int i = 0; TriangleTable[voxelIndex][i] != -1; i += 3)
-                {
-                    std::vector<LinePoint> pts;
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 0]]);
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 1]]);
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 2]]);
+            if (mBatchSink)
+            {
+                queueTriangles(indices, first);
+            }
+        }
 
-                    for (auto& pt : pts)
-                    {
-                        // Check if we have seen this point before.
-                        auto entry = indexMap.find(pt.edge);
-                        if (entry != indexMap.end())
-                        {
-                            // We have, so just insert the index.
-                            mMesh.indices().push_back((*entry).second);
-                        }
-                        else
-                        {
-                            // We haven't, so insert it.
-                            mMesh.vertices().push_back(pt.point.value.xyz());
-                            mMesh.normals().push_back(-pt.point.g);
-                            mMesh.indices().push_back(mMesh.vertices().size() - 1);
-                            indexMap.insert(
-                                std::pair<std::uint128_t, std::uint32_t>(pt.edge,
-                                    mMesh.vertices().size() - 1));
-                        }
-                    }
-                }
+        SurfaceVoxel Bsoid::makeSurfaceVoxel(Voxel const& voxel)
+        {
+            // The crossings are found now, while the corners are at hand, so
+            // only their mesh indices need to be kept.
+            SurfaceVoxel surface;
+            surface.id = BsoidHash64::hash(voxel.id.x, voxel.id.y,
+                voxel.id.z);
+            surface.mask = voxelMask(voxel);
+            surface.firstEdge = 0;
+
+            auto crossed = EdgeTable[surface.mask];
+            if (crossed == 0)
+            {
+                return surface;
+            }
 
+            std::array<std::uint32_t, 12> edges;
+            findCrossings(voxel, surface.mask, edges);
+
+            std::size_t count = 0;
+            for (std::size_t e = 0; e < edges.size(); ++e)
+            {
+                count += (crossed >> e) & 1;
             }
-#else
-            std::mutex indexMapMutex;
-            auto loop = [&indexMap, &indexMapMutex, this](std::size_t i)
+
+            auto next = mVoxelEdges.grow_by(count);
+            surface.firstEdge = static_cast<std::uint32_t>(
+                next - mVoxelEdges.begin());
+            for (std::size_t e = 0; e < edges.size(); ++e)
             {
-                Voxel& voxel = mVoxels[i];
-                std::uint32_t voxelIndex = 0;
-                std::vector<std::uint32_t> coeffs =
-                { 1, 2, 4, 8, 16, 32, 64, 128 };
-                for (std::size_t i = 0; i < voxel.points.size(); ++i)
+                if (crossed & (1 << e))
                 {
-                    voxelIndex |= (voxel.points[i].value.w < mMagic) ?
-                        coeffs[i] : 0;
+                    *next++ = edges[e];
                 }
+            }
 
-                if (EdgeTable[voxelIndex] == 0)
-                {
-                    return;
-                }
+            return surface;
+        }
 
-                std::vector<LinePoint> vertList(12);
-                if (EdgeTable[voxelIndex] & 1)
-                {
-                    vertList[0] = generateLinePoint(
-                        voxel.id + VoxelDecals[0],
-                        voxel.id + VoxelDecals[1],
-                        voxel.points[0],
-                        voxel.points[1]);
-                }
+        void Bsoid::queueTriangles(std::vector<std::uint32_t> const& indices,
+            std::size_t first)
+        {
+            // Vertices are only added to the mesh once everything is done,
+            // so their final indices start after whatever is in it now.
+            auto base = static_cast<std::uint32_t>(mMesh.vertices().size());
+            auto& batch = mPendingBatches.local();
+            for (auto i = first; i < indices.size(); ++i)
+            {
+                atlas::math::Point position;
+                atlas::math::Normal normal;
+                getVertex(indices[i], position, normal);
+                batch.indices.push_back(base + indices[i]);
+                batch.vertices.push_back(position);
+                batch.normals.push_back(normal);
+            }
 
-                if (EdgeTable[voxelIndex] & 2)
-                {
-                    vertList[1] = generateLinePoint(
-                        voxel.id + VoxelDecals[1],
-                        voxel.id + VoxelDecals[2],
-                        voxel.points[1],
-                        voxel.points[2]);
-                }
+            if (batch.indices.size() >= 3 * triangleBatchSize)
+            {
+                mBatchSink->try_put(
+                    std::make_shared<TriangleBatch>(std::move(batch)));
+                batch = TriangleBatch();
+            }
+        }
 
-                if (EdgeTable[voxelIndex] & 4)
+        void Bsoid::flushTriangles()
+        {
+            if (mBatchSink)
+            {
+                for (auto& batch : mPendingBatches)
                 {
-                    vertList[2] = generateLinePoint(
-                        voxel.id + VoxelDecals[2],
-                        voxel.id + VoxelDecals[3],
-                        voxel.points[2],
-                        voxel.points[3]);
+                    if (!batch.indices.empty())
+                    {
+                        mBatchSink->try_put(
+                            std::make_shared<TriangleBatch>(std::move(batch)));
+                    }
                 }
+            }
+            mPendingBatches.clear();
+        }
 
-                if (EdgeTable[voxelIndex] & 8)
-                {
-                    vertList[3] = generateLinePoint(
-                        voxel.id + VoxelDecals[3],
-                        voxel.id + VoxelDecals[0],
-                        voxel.points[3],
-                        voxel.points[0]);
-                }
+        std::uint8_t Bsoid::voxelMask(Voxel const& voxel) const
+        {
+            std::uint8_t mask = 0;
+            for (std::size_t i = 0; i < voxel.points.size(); ++i)
+            {
+                mask |= (voxel.points[i].value.w < mMagic) ? (1 << i) : 0;
+            }
 
-                if (EdgeTable[voxelIndex] & 16)
-                {
-                    vertList[4] = generateLinePoint(
-                        voxel.id + VoxelDecals[4],
-                        voxel.id + VoxelDecals[5],
-                        voxel.points[4],
-                        voxel.points[5]);
-                }
+            return mask;
+        }
 
-                if (EdgeTable[voxelIndex] & 32)
-                {
-                    vertList[5] = generateLinePoint(
-                        voxel.id + VoxelDecals[5],
-                        voxel.id + VoxelDecals[6],
-                        voxel.points[5],
-                        voxel.points[6]);
-                }
+        void Bsoid::findCrossings(Voxel const& voxel, std::uint8_t mask,
+            std::array<std::uint32_t, 12>& edges)
+        {
+            auto voxelIndex = mask;
+            if (EdgeTable[voxelIndex] & 1)
+            {
+                edges[0] = generateLinePoint(
+                    voxel.id + VoxelDecals[0],
+                    voxel.id + VoxelDecals[1],
+                    voxel.points[0],
+                    voxel.points[1]);
+            }
 
-                if (EdgeTable[voxelIndex] & 64)
-                {
-                    vertList[6] = generateLinePoint(
-                        voxel.id + VoxelDecals[6],
-                        voxel.id + VoxelDecals[7],
-                        voxel.points[6],
-                        voxel.points[7]);
-                }
+            if (EdgeTable[voxelIndex] & 2)
+            {
+                edges[1] = generateLinePoint(
+                    voxel.id + VoxelDecals[1],
+                    voxel.id + VoxelDecals[2],
+                    voxel.points[1],
+                    voxel.points[2]);
+            }
 
-                if (EdgeTable[voxelIndex] & 128)
-                {
-                    vertList[7] = generateLinePoint(
-                        voxel.id + VoxelDecals[7],
-                        voxel.id + VoxelDecals[4],
-                        voxel.points[7],
-                        voxel.points[4]);
-                }
+            if (EdgeTable[voxelIndex] & 4)
+            {
+                edges[2] = generateLinePoint(
+                    voxel.id + VoxelDecals[2],
+                    voxel.id + VoxelDecals[3],
+                    voxel.points[2],
+                    voxel.points[3]);
+            }
 
-                if (EdgeTable[voxelIndex] & 256)
-                {
-                    vertList[8] = generateLinePoint(
-                        voxel.id + VoxelDecals[0],
-                        voxel.id + VoxelDecals[4],
-                        voxel.points[0],
-                        voxel.points[4]);
-                }
+            if (EdgeTable[voxelIndex] & 8)
+            {
+                edges[3] = generateLinePoint(
+                    voxel.id + VoxelDecals[3],
+                    voxel.id + VoxelDecals[0],
+                    voxel.points[3],
+                    voxel.points[0]);
+            }
 
-                if (EdgeTable[voxelIndex] & 512)
-                {
-                    vertList[9] = generateLinePoint(
-                        voxel.id + VoxelDecals[1],
-                        voxel.id + VoxelDecals[5],
-                        voxel.points[1],
-                        voxel.points[5]);
-                }
+            if (EdgeTable[voxelIndex] & 16)
+            {
+                edges[4] = generateLinePoint(
+                    voxel.id + VoxelDecals[4],
+                    voxel.id + VoxelDecals[5],
+                    voxel.points[4],
+                    voxel.points[5]);
+            }
 
-                if (EdgeTable[voxelIndex] & 1024)
-                {
-                    vertList[10] = generateLinePoint(
-                        voxel.id + VoxelDecals[2],
-                        voxel.id + VoxelDecals[6],
-                        voxel.points[2],
-                        voxel.points[6]);
-                }
+            if (EdgeTable[voxelIndex] & 32)
+            {
+                edges[5] = generateLinePoint(
+                    voxel.id + VoxelDecals[5],
+                    voxel.id + VoxelDecals[6],
+                    voxel.points[5],
+                    voxel.points[6]);
+            }
 
-                if (EdgeTable[voxelIndex] & 2048)
-                {
-                    vertList[11] = generateLinePoint(
-                        voxel.id + VoxelDecals[3],
-                        voxel.id + VoxelDecals[7],
-                        voxel.points[3],
-                        voxel.points[7]);
-                }
+            if (EdgeTable[voxelIndex] & 64)
+            {
+                edges[6] = generateLinePoint(
+                    voxel.id + VoxelDecals[6],
+                    voxel.id + VoxelDecals[7],
+                    voxel.points[6],
+                    voxel.points[7]);
+            }
 
-                for (int i = 0; TriangleTable[voxelIndex][i] != -1; i += 3)
-                {
-                    std::vector<LinePoint> pts;
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 0]]);
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 1]]);
-                    pts.push_back(vertList[TriangleTable[voxelIndex][i + 2]]);
+            if (EdgeTable[voxelIndex] & 128)
+            {
+                edges[7] = generateLinePoint(
+                    voxel.id + VoxelDecals[7],
+                    voxel.id + VoxelDecals[4],
+                    voxel.points[7],
+                    voxel.points[4]);
+            }
 
-                    std::lock_guard<std::mutex> lock(indexMapMutex);
-                    for (auto& pt : pts)
-                    {
-                        auto entry = indexMap.find(pt.edge);
-                        if (entry != indexMap.end())
-                        {
-                            mMesh.indices().push_back((*entry).second);
-                        }
-                        else
-                        {
-                            mMesh.vertices().push_back(pt.point.value.xyz());
-                            mMesh.normals().push_back(-pt.point.g);
-                            mMesh.indices().push_back(mMesh.vertices().size() - 1);
-                            indexMap.insert(
-                                std::pair<std::uint128_t, std::uint32_t>(
-                                    pt.edge, mMesh.vertices().size() - 1));
-                        }
-                    }
-                }
-            };
+            if (EdgeTable[voxelIndex] & 256)
+            {
+                edges[8] = generateLinePoint(
+                    voxel.id + VoxelDecals[0],
+                    voxel.id + VoxelDecals[4],
+                    voxel.points[0],
+                    voxel.points[4]);
+            }
 
-            tbb::parallel_for(static_cast<std::size_t>(0), mVoxels.size(), loop);
-#endif
+            if (EdgeTable[voxelIndex] & 512)
+            {
+                edges[9] = generateLinePoint(
+                    voxel.id + VoxelDecals[1],
+                    voxel.id + VoxelDecals[5],
+                    voxel.points[1],
+                    voxel.points[5]);
+            }
+
+            if (EdgeTable[voxelIndex] & 1024)
+            {
+                edges[10] = generateLinePoint(
+                    voxel.id + VoxelDecals[2],
+                    voxel.id + VoxelDecals[6],
+                    voxel.points[2],
+                    voxel.points[6]);
+            }
+
+            if (EdgeTable[voxelIndex] & 2048)
+            {
+                edges[11] = generateLinePoint(
+                    voxel.id + VoxelDecals[3],
+                    voxel.id + VoxelDecals[7],
+                    voxel.points[3],
+                    voxel.points[7]);
+            }
         }
 
         bool Bsoid::validVoxel(Voxel const& v)
@@ -973,14 +1502,13 @@ namespace bsoid
 
         void Bsoid::validateVoxels()
         {
-            std::map<std::uint64_t, Voxel> seenMap;
+            std::unordered_set<std::uint64_t> seen;
             for (auto& voxel : mVoxels)
             {
-                auto hash = BsoidHash64::hash(voxel.id.x, voxel.id.y, voxel.id.z);
-                seenMap.insert(std::pair<std::uint64_t, Voxel>(hash, voxel));
+                seen.insert(voxel.id);
             }
 
-            ATLAS_ASSERT(seenMap.size() == mVoxels.size(),
+            ATLAS_ASSERT(seen.size() == mVoxels.size(),
                 "There should be no repeated voxels in the lattice.");
             DEBUG_LOG("Voxel validation succeeded.");
         }
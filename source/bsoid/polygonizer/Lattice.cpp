@@ -1,4 +1,6 @@
 #include "bsoid/polygonizer/Lattice.hpp"
+#include "bsoid/polygonizer/Hash.hpp"
+#include "bsoid/polygonizer/Tables.hpp"
 
 #include <functional>
 #include <unordered_set>
@@ -7,7 +9,8 @@ namespace bsoid
 {
     namespace polygonizer
     {
-        void Lattice::makeLattice(std::vector<Voxel> const& voxels)
+        void Lattice::makeLattice(std::vector<SurfaceVoxel> const& voxels,
+            atlas::math::Point const& origin, atlas::math::Point const& delta)
         {
             using atlas::math::Point;
 
@@ -52,9 +55,13 @@ namespace bsoid
             std::uint32_t idxStart = 0;
             for (auto& voxel : voxels)
             {
-                for (auto& pt : voxel.points)
+                // Voxels no longer carry their corners, so they are placed
+                // back on the grid from their ids.
+                auto id = BsoidHash64::unhash(voxel.id);
+                for (auto& decal : VoxelDecals)
                 {
-                    verts.push_back(pt.value.xyz());
+                    Point p(id + decal);
+                    verts.push_back(origin + p * delta);
                 }
 
                 idxs.push_back(idxStart + 0);
@@ -334,7 +334,9 @@ namespace bsoid
             mTree(std::make_unique<tree::BlobTree>(model)),
             mMagic(isoValue),
             mName(name)
-        { }
+        {
+            mTree->freeze();
+        }
 
         MarchingCubes::MarchingCubes(MarchingCubes&& mc) :
             mResolution(mc.mResolution),
@@ -349,6 +351,7 @@ namespace bsoid
         void MarchingCubes::setModel(tree::BlobTree const& model)
         {
             mTree = std::make_unique<tree::BlobTree>(model);
+            mTree->freeze();
         }
 
         void MarchingCubes::setIsoValue(float isoValue)
@@ -459,22 +462,28 @@ namespace bsoid
             delta.y /= mResolution.y - 1;
             delta.z /= mResolution.z - 1;
 
+            // Each row along z is evaluated as a single batch.
             tbb::parallel_for(static_cast<std::uint32_t>(0), mResolution.x,
                 [this, start, delta](std::uint32_t x) {
                 tbb::parallel_for(static_cast<std::uint32_t>(0), mResolution.y,
                     [this, start, delta, x](std::uint32_t y) {
-                    tbb::parallel_for(static_cast<std::uint32_t>(0), mResolution.z,
-                        [this, start, delta, x, y](std::uint32_t z) {
-                        Point pt =
-                        {
-                            start.x + x * delta.x,
-                            start.y + y * delta.y,
-                            start.z + z * delta.z
-                        };
-
-                        mGrid[x][y][z].data.w = mTree->eval(pt);
-                        mGrid[x][y][z].data.xyz = pt;
-                    });
+                    std::vector<float> xs(mResolution.z, start.x + x * delta.x);
+                    std::vector<float> ys(mResolution.z, start.y + y * delta.y);
+                    std::vector<float> zs(mResolution.z);
+                    std::vector<float> values(mResolution.z);
+                    for (std::uint32_t z = 0; z < mResolution.z; ++z)
+                    {
+                        zs[z] = start.z + z * delta.z;
+                    }
+
+                    mTree->evalPoints({ xs.data(), ys.data(), zs.data(), 
+                        zs.size() }, values.data());
+
+                    for (std::uint32_t z = 0; z < mResolution.z; ++z)
+                    {
+                        mGrid[x][y][z].data.w = values[z];
+                        mGrid[x][y][z].data.xyz = Point(xs[z], ys[z], zs[z]);
+                    }
                 });
             });
         }
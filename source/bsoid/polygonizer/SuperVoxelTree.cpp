@@ -0,0 +1,219 @@
+#include "bsoid/polygonizer/SuperVoxelTree.hpp"
+
+#include <glm/gtx/component_wise.hpp>
+
+namespace bsoid
+{
+    namespace polygonizer
+    {
+        SuperVoxelTree::SuperVoxelTree() :
+            mBlobTree(nullptr),
+            mMinCellSize(1),
+            mMaxLeaves(0),
+            mIsoValue(0.5f),
+            mCodec(nullptr),
+            mLookups(0),
+            mMisses(0),
+            mSubTreesSize(0),
+            mPruned(0)
+        { }
+
+        SuperVoxelTree::~SuperVoxelTree()
+        {
+            clear();
+        }
+
+        void SuperVoxelTree::makeTree(tree::BlobTree const* blobTree,
+            atlas::math::Point const& origin, atlas::math::Point const& delta,
+            std::uint64_t gridSize, std::uint64_t minCellSize,
+            std::size_t maxLeaves, float isoValue, SampleCodec const* codec)
+        {
+            clear();
+
+            mBlobTree = blobTree;
+            mOrigin = origin;
+            mDelta = delta;
+            mMinCellSize = minCellSize;
+            mMaxLeaves = maxLeaves;
+            mIsoValue = isoValue;
+            mCodec = codec;
+
+            // The lattice has gridSize + 1 corners along each axis.
+            mRoot = makeCell(PointId(0), PointId(gridSize + 1));
+        }
+
+        void SuperVoxelTree::clear()
+        {
+            // Everything that points into the arena has to be gone before it
+            // is released.
+            mRoot.reset();
+            mSuperVoxels.clear();
+            mSubTrees.clear();
+            mArena.release();
+
+            mLookups = 0;
+            mMisses = 0;
+            mSubTreesSize = 0;
+            mPruned = 0;
+        }
+
+        SuperVoxel& SuperVoxelTree::find(PointId const& corner)
+        {
+            Cell* cell = mRoot.get();
+            while (!cell->superVoxel)
+            {
+                auto mid = cell->start + (cell->end - cell->start) /
+                    PointId(2);
+                std::uint64_t child =
+                    ((corner.x >= mid.x) ? 4 : 0) |
+                    ((corner.y >= mid.y) ? 2 : 0) |
+                    ((corner.z >= mid.z) ? 1 : 0);
+                cell = &getChild(*cell, child);
+            }
+
+            return *cell->superVoxel;
+        }
+
+        SuperVoxel& SuperVoxelTree::operator[](std::uint64_t index)
+        {
+            return *mSuperVoxels[index];
+        }
+
+        std::size_t SuperVoxelTree::numSuperVoxels() const
+        {
+            return mSuperVoxels.size();
+        }
+
+        std::size_t SuperVoxelTree::numSubTrees() const
+        {
+            return mSubTrees.size();
+        }
+
+        std::size_t SuperVoxelTree::subTreeLookups() const
+        {
+            return mLookups.load();
+        }
+
+        std::size_t SuperVoxelTree::subTreeHits() const
+        {
+            return mLookups.load() - mMisses.load();
+        }
+
+        std::size_t SuperVoxelTree::numPruned() const
+        {
+            return mPruned.load();
+        }
+
+        std::size_t SuperVoxelTree::size() const
+        {
+            std::size_t total = 0;
+            for (auto& sv : mSuperVoxels)
+            {
+                total += sv->size();
+            }
+
+            return total + mSubTreesSize.load() + mArena.size();
+        }
+
+        std::unique_ptr<SuperVoxelTree::Cell> SuperVoxelTree::makeCell(
+            PointId const& start, PointId const& end)
+        {
+            using atlas::math::Point;
+            using atlas::utils::BBox;
+
+            // Edges leave the corners we own in both directions, so the
+            // cell has to reach one voxel past them on either side for the
+            // subtree to cover every point that we interpolate.
+            Point lo(start);
+            lo = glm::max(lo - Point(1.0f), Point(0.0f));
+            BBox box(mOrigin + lo * mDelta, mOrigin + Point(end) * mDelta);
+
+            // Only the nodes are gathered here. The subtree itself is built
+            // once this cell turns out to be a leaf, and only if no other
+            // leaf has built the same one already.
+            SubTreeKey key;
+            auto numLeaves = mBlobTree->getSubTreeNodes(box, key);
+
+            auto cell = std::make_unique<Cell>();
+            cell->start = start;
+            cell->end = end;
+            cell->superVoxel = nullptr;
+
+            bool canSplit = glm::compMin(end - start) > mMinCellSize;
+            if (!key.empty() && numLeaves > mMaxLeaves && canSplit)
+            {
+                return cell;
+            }
+
+            // The box already reaches every corner that an edge we own can
+            // lead to, so if the iso-value is out of bounds over it, every
+            // one of those corners is on the same side of the surface.
+            auto sv = std::make_unique<SuperVoxel>();
+            auto& subTree = findSubTree(key, box);
+            sv->program = &subTree.program;
+            if (subTree.field)
+            {
+                auto range = subTree.field->evalInterval(box);
+                if (!range.contains(mIsoValue))
+                {
+                    ++mPruned;
+                    sv->program = nullptr;
+                    sv->constant = (range.lo > mIsoValue) ?
+                        range.lo : range.hi;
+                }
+            }
+            sv->codec = mCodec;
+            sv->cell = box;
+            sv->setCorners(start, end - start);
+
+            cell->superVoxel = sv.get();
+            auto it = mSuperVoxels.push_back(std::move(sv));
+            cell->superVoxel->id =
+                static_cast<std::uint64_t>(it - mSuperVoxels.begin());
+            return cell;
+        }
+
+        SuperVoxelTree::Cell& SuperVoxelTree::getChild(Cell& cell,
+            std::uint64_t child)
+        {
+            std::call_once(cell.childFlags[child], [this, &cell, child]()
+            {
+                auto mid = cell.start + (cell.end - cell.start) / PointId(2);
+                PointId start, end;
+                start.x = (child & 4) ? mid.x : cell.start.x;
+                start.y = (child & 2) ? mid.y : cell.start.y;
+                start.z = (child & 1) ? mid.z : cell.start.z;
+                end.x = (child & 4) ? cell.end.x : mid.x;
+                end.y = (child & 2) ? cell.end.y : mid.y;
+                end.z = (child & 1) ? cell.end.z : mid.z;
+                cell.children[child] = makeCell(start, end);
+            });
+
+            return *cell.children[child];
+        }
+
+        SuperVoxelTree::SubTree const& SuperVoxelTree::findSubTree(
+            SubTreeKey const& key, atlas::utils::BBox const& box)
+        {
+            ++mLookups;
+            auto& subTree = mSubTrees.findOrCreate(key, [this, &box]()
+            {
+                ++mMisses;
+
+                std::size_t numLeaves;
+                std::unique_ptr<SubTree> subTree(new SubTree);
+                subTree->field = mBlobTree->getSubTree(box, numLeaves,
+                    &mArena);
+                if (subTree->field)
+                {
+                    subTree->program.compile(*subTree->field);
+                }
+
+                mSubTreesSize += subTree->program.size();
+                return subTree;
+            });
+
+            return *subTree;
+        }
+    }
+}
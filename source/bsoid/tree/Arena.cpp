@@ -0,0 +1,63 @@
+#include "bsoid/tree/Arena.hpp"
+
+#include <algorithm>
+
+namespace bsoid
+{
+    namespace tree
+    {
+        Arena::Arena(std::size_t blockSize) :
+            mBlockSize(blockSize)
+        { }
+
+        void* Arena::allocate(std::size_t size, std::size_t alignment)
+        {
+            auto& blocks = mBlocks.local();
+            if (!blocks.empty())
+            {
+                auto& block = blocks.back();
+                void* ptr = block.data.get() + block.used;
+                std::size_t space = block.size - block.used;
+                if (std::align(alignment, size, ptr, space))
+                {
+                    block.used = block.size - space + size;
+                    return ptr;
+                }
+            }
+
+            // Requests that don't fit in a regular block get one of their
+            // own. The new block becomes the current one either way, and
+            // whatever was left in the last one is wasted.
+            Block block;
+            block.size = std::max(mBlockSize, size + alignment);
+            block.data.reset(new char[block.size]);
+
+            void* ptr = block.data.get();
+            std::size_t space = block.size;
+            std::align(alignment, size, ptr, space);
+            block.used = block.size - space + size;
+
+            blocks.push_back(std::move(block));
+            return ptr;
+        }
+
+        void Arena::release()
+        {
+            mBlocks.clear();
+        }
+
+        std::size_t Arena::size() const
+        {
+            std::size_t total = 0;
+            for (auto& blocks : mBlocks)
+            {
+                for (auto& block : blocks)
+                {
+                    total += block.size;
+                }
+            }
+
+            return total;
+        }
+    }
+}
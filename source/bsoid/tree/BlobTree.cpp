@@ -1,11 +1,159 @@
 #include "bsoid/tree/BlobTree.hpp"
+#include "bsoid/operators/Blend.hpp"
+#include "bsoid/operators/Union.hpp"
+#include "bsoid/operators/Intersection.hpp"
+#include "bsoid/operators/Transform.hpp"
 
 #include <sstream>
+#include <typeinfo>
 
 namespace bsoid
 {
     namespace tree
     {
+        namespace
+        {
+            using fields::ImplicitFieldPtr;
+            using operators::ImplicitOperator;
+            using operators::Transform;
+
+            // Blend, Union and Intersection fold their children with an
+            // associative operation whose identity they start from. So a
+            // child of the same kind can give its children to the parent,
+            // and a single child is the same field as the operator.
+            bool isAssociative(ImplicitOperator const& op)
+            {
+                return dynamic_cast<operators::Blend const*>(&op) ||
+                    dynamic_cast<operators::Union const*>(&op) ||
+                    dynamic_cast<operators::Intersection const*>(&op);
+            }
+
+            // Pushes the transform outer into a frozen child. Another
+            // transform is composed with it, and an operator whose children
+            // are all transforms has it composed into each of them, which
+            // never costs more transforms than it saves. Anything else can't
+            // absorb it, and null is returned.
+            ImplicitFieldPtr compose(Transform const& outer,
+                ImplicitFieldPtr const& child)
+            {
+                auto inner = std::dynamic_pointer_cast<Transform>(child);
+                if (inner)
+                {
+                    if (inner->getFields().empty())
+                    {
+                        return child;
+                    }
+
+                    auto result = std::make_shared<Transform>(
+                        outer.getTransform() * inner->getTransform(),
+                        inner->getInverse() * outer.getInverse());
+                    result->insertField(inner->getFields().front());
+                    result->freezeBounds();
+                    return result;
+                }
+
+                auto op = std::dynamic_pointer_cast<ImplicitOperator>(child);
+                if (!op || op->getFields().empty() || !isAssociative(*op))
+                {
+                    return nullptr;
+                }
+
+                for (auto& field : op->getFields())
+                {
+                    if (!std::dynamic_pointer_cast<Transform>(field))
+                    {
+                        return nullptr;
+                    }
+                }
+
+                auto result = op->makeEmpty();
+                for (auto& field : op->getFields())
+                {
+                    result->insertField(compose(outer, field));
+                }
+                result->freezeBounds();
+                return result;
+            }
+
+            // Builds a frozen copy of the tree under field. Leaves are shared
+            // with the original, so their evaluations are still counted.
+            ImplicitFieldPtr freezeField(ImplicitFieldPtr const& field)
+            {
+                auto op = std::dynamic_pointer_cast<ImplicitOperator>(field);
+                if (!op || op->getFields().empty())
+                {
+                    return field;
+                }
+
+                auto transform = std::dynamic_pointer_cast<Transform>(op);
+                if (transform)
+                {
+                    auto child = freezeField(op->getFields().front());
+                    auto composed = compose(*transform, child);
+                    if (composed)
+                    {
+                        return composed;
+                    }
+
+                    auto result = std::make_shared<Transform>(
+                        transform->getTransform(), transform->getInverse());
+                    result->insertField(child);
+                    result->freezeBounds();
+                    return result;
+                }
+
+                bool associative = isAssociative(*op);
+                auto result = op->makeEmpty();
+                for (auto& f : op->getFields())
+                {
+                    auto child = freezeField(f);
+                    auto childOp =
+                        std::dynamic_pointer_cast<ImplicitOperator>(child);
+                    if (associative && childOp &&
+                        typeid(*childOp) == typeid(*op))
+                    {
+                        for (auto& grandChild : childOp->getFields())
+                        {
+                            result->insertField(grandChild);
+                        }
+                        continue;
+                    }
+
+                    result->insertField(child);
+                }
+
+                if (associative && result->getFields().size() == 1)
+                {
+                    return result->getFields().front();
+                }
+
+                result->freezeBounds();
+                return result;
+            }
+
+            // Rebuilds the volume tree over the frozen fields. The subtree
+            // of a node with children is assembled from the nodes below it,
+            // and its own field is only used as a template for the
+            // operator, so only the fields at the leaves are frozen.
+            NodePtr freezeNode(NodePtr const& node)
+            {
+                auto children = node->getChildren();
+                if (children.empty())
+                {
+                    return std::make_shared<Node>(
+                        freezeField(node->getField()));
+                }
+
+                auto result = std::make_shared<Node>(node->getField());
+                for (auto& child : children)
+                {
+                    result->addChild(freezeNode(child));
+                }
+
+                return result;
+            }
+        }
+
         BlobTree::BlobTree()
         { }
 
@@ -62,25 +210,110 @@ namespace bsoid
             // The final index is the parent, so just assign that and clear
             // the copies of the node.
             mVolumeTree = mNodes[tree.size() - 1];
+            mIndex = std::make_shared<SubTreeIndex>(mVolumeTree);
         }
 
         void BlobTree::insertFieldTree(fields::ImplicitFieldPtr const& tree)
         {
+            // The tree is evaluated through the program, so it has to be
+            // complete by the time it is inserted.
             mFieldTree = tree;
+            mProgram.compile(*mFieldTree);
+        }
+
+        void BlobTree::freeze()
+        {
+            if (mFieldTree)
+            {
+                mFieldTree = freezeField(mFieldTree);
+                mProgram.compile(*mFieldTree);
+            }
+
+            if (mVolumeTree)
+            {
+                mVolumeTree = freezeNode(mVolumeTree);
+                mIndex = std::make_shared<SubTreeIndex>(mVolumeTree);
+            }
         }
 
         float BlobTree::eval(atlas::math::Point const& p) const
         {
-            // Theoretically, we should be able to do this:
-            //using atlas::utils::BBox;
-            //auto subTree = getSubTree(BBox(p, p));
-            //return subTree->eval(p);
-            return mFieldTree->eval(p);
+            return localProgram(p).eval(p);
         }
 
         atlas::math::Normal BlobTree::grad(atlas::math::Point const& p) const
         {
-            return mFieldTree->grad(p);
+            return localProgram(p).grad(p);
+        }
+
+        fields::FieldValue BlobTree::evalGrad(atlas::math::Point const& p) const
+        {
+            return localProgram(p).evalGrad(p);
+        }
+
+        void BlobTree::evalPoints(fields::PointSpan const& points,
+            float* values) const
+        {
+            if (!mIndex)
+            {
+                mProgram.evalBatch(points, values);
+                return;
+            }
+
+            auto cellOf = [this, &points](std::size_t i)
+            {
+                return mIndex->findCell(
+                    { points.x[i], points.y[i], points.z[i] });
+            };
+
+            std::size_t begin = 0;
+            while (begin < points.size)
+            {
+                auto cell = cellOf(begin);
+                auto end = begin + 1;
+                while (end < points.size && cellOf(end) == cell)
+                {
+                    ++end;
+                }
+
+                auto& program = (cell == SubTreeIndex::npos) ? mProgram :
+                    mIndex->getProgram(cell);
+                program.evalBatch(points.subspan(begin, end - begin),
+                    values + begin);
+                begin = end;
+            }
+        }
+
+        void BlobTree::evalBatch(fields::PointSpan const& points,
+            float* values) const
+        {
+            mProgram.evalBatch(points, values);
+        }
+
+        // Points outside the volume tree fall back to the whole tree, which
+        // culls all of its children there anyway.
+        fields::Program const& BlobTree::localProgram(
+            atlas::math::Point const& p) const
+        {
+            if (!mIndex)
+            {
+                return mProgram;
+            }
+
+            auto cell = mIndex->findCell(p);
+            return (cell == SubTreeIndex::npos) ? mProgram :
+                mIndex->getProgram(cell);
+        }
+
+        fields::FieldInterval BlobTree::evalInterval(
+            atlas::utils::BBox const& box) const
+        {
+            if (!mFieldTree)
+            {
+                return { 0.0f, 0.0f };
+            }
+
+            return mFieldTree->evalInterval(box);
         }
 
         fields::ImplicitFieldPtr BlobTree::getSubTree(
@@ -89,6 +322,20 @@ namespace bsoid
             return mVolumeTree->subTree(box);
         }
 
+        fields::ImplicitFieldPtr BlobTree::getSubTree(
+            atlas::utils::BBox const& box, std::size_t& numLeaves,
+            Arena* arena) const
+        {
+            numLeaves = 0;
+            return mVolumeTree->subTree(box, numLeaves, arena);
+        }
+
+        std::size_t BlobTree::getSubTreeNodes(atlas::utils::BBox const& box,
+            std::vector<Node const*>& nodes) const
+        {
+            return mVolumeTree->collect(box, nodes);
+        }
+
         atlas::utils::BBox BlobTree::getTreeBox() const
         {
             return mVolumeTree->getBBox();
@@ -99,21 +346,68 @@ namespace bsoid
             return mFieldTree->getSeeds();
         }
 
+        std::size_t BlobTree::validateIndex(int resolution,
+            std::size_t samples) const
+        {
+            using atlas::math::Point;
+
+            if (!mVolumeTree || samples < 2)
+            {
+                return 0;
+            }
+
+            // The grid reaches a little past the bounds, so that the points
+            // outside of the index are looked at as well.
+            auto box = mVolumeTree->getBBox();
+            box.expand(0.1f * glm::length(box.pMax - box.pMin));
+            auto delta = (box.pMax - box.pMin) /
+                static_cast<float>(samples - 1);
+
+            SubTreeIndex index(mVolumeTree, resolution);
+            std::size_t mismatches = 0;
+            for (std::size_t i = 0; i < samples; ++i)
+            {
+                for (std::size_t j = 0; j < samples; ++j)
+                {
+                    for (std::size_t k = 0; k < samples; ++k)
+                    {
+                        auto p = box.pMin + delta * Point(i, j, k);
+                        auto cell = index.findCell(p);
+                        auto const& program = (cell == SubTreeIndex::npos) ?
+                            mProgram : index.getProgram(cell);
+                        if (program.eval(p) != mProgram.eval(p))
+                        {
+                            ++mismatches;
+                        }
+                    }
+                }
+            }
+
+            return mismatches;
+        }
+
         std::string BlobTree::getFieldSummary() const
         {
+#if defined(BSOID_EVAL_COUNTERS)
+            // Every field keeps one counter per thread, which are summed up
+            // here.
             std::stringstream summary;
             std::uint64_t total = 0;
             int i = 0;
             for (auto& field : mSkeletalFields)
             {
+                auto count = field->getCount();
                 summary << "Field " << std::to_string(i) << ": ";
-                summary << std::to_string(field->getCount()) << " evaluations.\n";
+                summary << std::to_string(count) << " evaluations.\n";
                 ++i;
-                total += field->getCount();
+                total += count;
             }
             summary << "Total field evaluations: " << std::to_string(total);
             summary << ".\n";
             return summary.str();
+#else
+            return "Field evaluation counters are disabled.\n";
+#endif
         }
     }
 }
\ No newline at end of file
@@ -19,6 +19,11 @@ namespace bsoid
             mBox = field->getBBox();
         }
 
+        fields::ImplicitFieldPtr Node::getField() const
+        {
+            return mField;
+        }
+
         atlas::utils::BBox Node::getBBox() const
         {
             return mBox;
@@ -57,6 +62,13 @@ namespace bsoid
 
         fields::ImplicitFieldPtr Node::subTree(
             atlas::utils::BBox const& cell) const
+        {
+            std::size_t numLeaves = 0;
+            return subTree(cell, numLeaves);
+        }
+
+        fields::ImplicitFieldPtr Node::subTree(atlas::utils::BBox const& cell,
+            std::size_t& numLeaves, Arena* arena) const
         {
             using operators::ImplicitOperatorPtr;
             using operators::ImplicitOperator;
@@ -70,6 +82,7 @@ namespace bsoid
             // we are a leaf, so just return the field as is.
             if (mChildren.empty())
             {
+                ++numLeaves;
                 return mField;
             }
 
@@ -82,18 +95,49 @@ namespace bsoid
 
             // We have successfully converted the pointer, so let's make a new
             // empty copy of the pointer.
-            auto result = op->makeEmpty();
+            auto result = op->makeEmpty(arena);
 
+            // Children that miss the cell are 0 all over it. Sums and maxima
+            // can simply leave them out, but they make an intersection 0 as
+            // well, and an operator with nothing left is 0 too. Either way
+            // the operator is dropped, which is what its parent takes as 0.
             for (auto& child : mChildren)
             {
-                auto childField = child->subTree(cell);
+                auto childField = child->subTree(cell, numLeaves, arena);
                 if (childField)
                 {
                     result->insertField(childField);
                 }
+                else if (op->needsAllChildren())
+                {
+                    return nullptr;
+                }
+            }
+
+            return (result->getFields().empty()) ? nullptr : result;
+        }
+
+        std::size_t Node::collect(atlas::utils::BBox const& cell,
+            std::vector<Node const*>& nodes) const
+        {
+            if (!mBox.overlaps(cell))
+            {
+                return 0;
+            }
+
+            nodes.push_back(this);
+            if (mChildren.empty())
+            {
+                return 1;
+            }
+
+            std::size_t numLeaves = 0;
+            for (auto& child : mChildren)
+            {
+                numLeaves += child->collect(cell, nodes);
             }
 
-            return result;
+            return numLeaves;
         }
     }
 }
\ No newline at end of file
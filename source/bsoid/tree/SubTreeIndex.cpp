@@ -0,0 +1,129 @@
+#include "bsoid/tree/SubTreeIndex.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace bsoid
+{
+    namespace tree
+    {
+        constexpr std::size_t SubTreeIndex::npos;
+
+        std::size_t SubTreeIndex::SubTreeHash::operator()(
+            SubTreeKey const& key) const
+        {
+            std::size_t h = key.size();
+            for (auto node : key)
+            {
+                h ^= std::hash<Node const*>()(node) +
+                    0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+            }
+
+            return h;
+        }
+
+        SubTreeIndex::SubTreeIndex(NodePtr const& root, int resolution) :
+            mRoot(root)
+        {
+            auto box = mRoot->getBBox();
+            std::vector<Node const*> nodes;
+            auto numLeaves = mRoot->collect(box, nodes);
+
+            // Aim for a handful of leaves in every cell. Boxes too large to
+            // be split are left as a single cell.
+            if (resolution <= 0)
+            {
+                resolution = static_cast<int>(std::min(32.0, std::max(1.0,
+                    2.0 * std::ceil(std::cbrt(
+                    static_cast<double>(numLeaves))))));
+            }
+            mOrigin = box.pMin;
+            mLimit = box.pMax;
+            for (int i = 0; i < 3; ++i)
+            {
+                float extent = box.pMax[i] - box.pMin[i];
+                bool valid = std::isfinite(extent) && extent > 0.0f;
+                mDims[i] = (valid) ? resolution : 1;
+                mCellSize[i] = (valid) ? extent / resolution : 1.0f;
+            }
+
+            std::size_t cells = static_cast<std::size_t>(mDims[0]) *
+                mDims[1] * mDims[2];
+            mCells.reset(new std::atomic<SubTree const*>[cells]);
+            for (std::size_t cell = 0; cell < cells; ++cell)
+            {
+                mCells[cell].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t SubTreeIndex::findCell(atlas::math::Point const& p) const
+        {
+            std::size_t cell = 0;
+            for (int i = 2; i >= 0; --i)
+            {
+                if (!(mOrigin[i] <= p[i] && p[i] <= mLimit[i]))
+                {
+                    return npos;
+                }
+
+                int index = std::min(mDims[i] - 1, static_cast<int>(
+                    std::floor((p[i] - mOrigin[i]) / mCellSize[i])));
+                cell = cell * mDims[i] + index;
+            }
+
+            return cell;
+        }
+
+        fields::Program const& SubTreeIndex::getProgram(std::size_t cell) const
+        {
+            auto subTree = mCells[cell].load(std::memory_order_acquire);
+            if (!subTree)
+            {
+                subTree = &makeSubTree(cell);
+            }
+
+            return subTree->program;
+        }
+
+        std::size_t SubTreeIndex::numSubTrees() const
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            return mSubTrees.size();
+        }
+
+        SubTreeIndex::SubTree const& SubTreeIndex::makeSubTree(
+            std::size_t cell) const
+        {
+            using atlas::math::Point;
+
+            Point index(static_cast<float>(cell % mDims[0]),
+                static_cast<float>((cell / mDims[0]) % mDims[1]),
+                static_cast<float>(cell / (mDims[0] * mDims[1])));
+
+            // The cells are padded a little, so that points that round into
+            // a neighbouring cell are still covered by its subtree.
+            atlas::utils::BBox box(mOrigin + index * mCellSize,
+                mOrigin + (index + Point(1.0f)) * mCellSize);
+            box.expand(1e-3f * glm::length(mCellSize));
+
+            SubTreeKey key;
+            mRoot->collect(box, key);
+
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto& subTree = mSubTrees[key];
+            if (!subTree)
+            {
+                subTree.reset(new SubTree);
+                subTree->field = mRoot->subTree(box);
+                if (subTree->field)
+                {
+                    subTree->program.compile(*subTree->field);
+                }
+            }
+
+            mCells[cell].store(subTree.get(), std::memory_order_release);
+            return *subTree;
+        }
+    }
+}
@@ -12,6 +12,7 @@
 #include <atlas/tools/ModellingScene.hpp>
 
 #include <fstream>
+#include <algorithm>
 #include <chrono>
 #include <thread>
 
@@ -160,6 +161,116 @@ int main()
         }
         mcFile.flush();
     }
+    else if (TestMode == 2)
+    {
+        // Compares the runtime trees against the same models written as
+        // static fields, with both polygonizers.
+        using namespace bsoid::models;
+        using Clock = std::chrono::high_resolution_clock;
+
+        Resolution res = { 128, 32 };
+        std::vector<std::pair<ModelFn, ModelFn>> pairs = {
+            { [res]() { return makeTorus(res); },
+              [res]() { return makeStaticTorus(res); } },
+            { [res]() { return makeButterfly(res); },
+              [res]() { return makeStaticButterfly(res); } },
+            { [res]() { return makeChain(res); },
+              [res]() { return makeStaticChain(res); } }
+        };
+        std::vector<std::pair<MCModelFn, MCModelFn>> mcPairs = {
+            { [res]() { return makeMCTorus(res); },
+              [res]() { return makeMCStaticTorus(res); } },
+            { [res]() { return makeMCButterfly(res); },
+              [res]() { return makeMCStaticButterfly(res); } },
+            { [res]() { return makeMCChain(res); },
+              [res]() { return makeMCStaticChain(res); } }
+        };
+
+        auto time = [](auto&& model)
+        {
+            auto start = Clock::now();
+            model.polygonize();
+            return std::chrono::duration<double>(Clock::now() - start).count();
+        };
+
+        std::fstream file("static_summary.txt", std::fstream::out);
+        for (auto& pair : pairs)
+        {
+            auto tree = pair.first();
+            auto expr = pair.second();
+            double treeTime = time(tree);
+            double exprTime = time(expr);
+            file << "Bsoid " << tree.getName() << ": " << treeTime <<
+                " seconds, static: " << exprTime << " seconds.\n";
+        }
+
+        for (auto& pair : mcPairs)
+        {
+            auto tree = pair.first();
+            auto expr = pair.second();
+            double treeTime = time(tree);
+            double exprTime = time(expr);
+            file << "MC " << tree.getName() << ": " << treeTime <<
+                " seconds, static: " << exprTime << " seconds.\n";
+        }
+    }
+    else if (TestMode == 3)
+    {
+        // Checks that the subtrees the models are evaluated with give the
+        // same field as the whole tree, at a range of index resolutions,
+        // and that the butterfly comes out without degenerate normals.
+        using namespace bsoid::models;
+
+        Resolution res = { 64, 16 };
+        std::vector<ModelFn> modelFns = {
+            [res]() { return makeIntersection(res); },
+            [res]() { return makeUnion(res); },
+            [res]() { return makeButterfly(res); },
+            [res]() { return makeParticles(res); },
+            [res]() { return makeChain(res); }
+        };
+
+        std::fstream file("check_summary.txt", std::fstream::out);
+        for (auto& modelFn : modelFns)
+        {
+            auto soid = modelFn();
+            for (int resolution : { 1, 2, 3, 4, 5, 8, 16, 32 })
+            {
+                auto mismatches = soid.tree()->validateIndex(resolution, 32);
+                file << soid.getName() << ", index resolution " <<
+                    resolution << ": " << mismatches << " mismatches.\n";
+                if (mismatches != 0)
+                {
+                    ERROR_LOG_V("Index of %s at resolution %d is wrong.",
+                        soid.getName().c_str(), resolution);
+                }
+            }
+        }
+
+        auto countZeroNormals = [](auto& model)
+        {
+            model.polygonize();
+            auto& normals = model.getMesh().normals();
+            return std::count_if(normals.begin(), normals.end(),
+                [](atlas::math::Normal const& n)
+                {
+                    return !(glm::length(n) > 0.0f);
+                });
+        };
+
+        auto soid = makeButterfly(res);
+        auto mc = makeMCButterfly(res);
+        auto soidZeros = countZeroNormals(soid);
+        auto mcZeros = countZeroNormals(mc);
+        file << "Bsoid " << soid.getName() << ": " << soidZeros <<
+            " zero normals.\n";
+        file << "MC " << mc.getName() << ": " << mcZeros <<
+            " zero normals.\n";
+        if (soidZeros != 0 || mcZeros != 0)
+        {
+            ERROR_LOG("The butterfly has zero normals.");
+        }
+    }
     else
     {
         auto modelFns = getModels({ 178, 45 });